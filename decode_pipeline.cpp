@@ -0,0 +1,266 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "decode_pipeline.h"
+#include "history_input.h"
+#include "page_cache.h"
+#include "spsc_queue.h"
+#include "trace.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			using clock_t = std::chrono::steady_clock;
+
+			struct page_batch_t {
+				int64_t index;
+				size_t reserved;	// against the memory budget
+				std::vector<uint8_t> bytes;	// the page and its CRC
+				std::vector<history_frame_t> frames;
+				std::vector<std::unique_ptr<history_entry_obj>> entries;	// one per frame, nullptr for errors
+
+				data_source_t page( ) {
+					return daw::range::make_range( bytes.data( ), bytes.data( ) + bytes.size( ) );
+				}
+
+				data_source_t body( ) {
+					return daw::range::make_range( bytes.data( ), bytes.data( ) + bytes.size( ) - 2 );
+				}
+			};	// page_batch_t
+
+			using page_queue_t = spsc_queue<std::unique_ptr<page_batch_t>>;
+			using text_queue_t = spsc_queue<std::string>;
+
+			template<typename Func>
+			auto timed( pipeline_stage_stats_t & stats, char const * stage, int64_t page, Func func ) {
+				daw::trace::scoped_span const span{ stage, "pipeline", "page", page };
+				auto const start = clock_t::now( );
+				auto result = func( );
+				stats.busy += clock_t::now( ) - start;
+				++stats.batches;
+				return result;
+			}
+
+			pipeline_stage_stats_t make_stats( std::string name ) {
+				return pipeline_stage_stats_t{ std::move( name ), std::chrono::nanoseconds{ 0 }, std::chrono::nanoseconds{ 0 }, 0 };
+			}
+		}	// namespace anonymous
+
+		double pipeline_stage_stats_t::utilisation( ) const {
+			if( wall.count( ) == 0 ) {
+				return 0.0;
+			}
+			return static_cast<double>(busy.count( ))/static_cast<double>(wall.count( ));
+		}
+
+		pipeline_options_t::pipeline_options_t( ):
+			queue_capacity{ 16 },
+			framing{ },
+			budget{ nullptr },
+			cache{ nullptr } { }
+
+		std::vector<pipeline_stage_stats_t> run_decode_pipeline( std::istream & input, std::ostream & output, pump_model_t const & pump_model, pipeline_options_t const & options ) {
+			// Without a budget use is still tracked
+			memory_budget tracking{ 0 };
+			auto & budget = options.budget ? *options.budget : tracking;
+			auto const pages_memory = budget.add_stage( "pages" );
+			auto const records_memory = budget.add_stage( "records" );
+			auto const output_memory = budget.add_stage( "output" );
+
+			std::vector<pipeline_stage_stats_t> stats{ make_stats( "ingest" ), make_stats( "frame" ), make_stats( "decode" ), make_stats( "encode" ), make_stats( "write" ) };
+			page_queue_t ingested{ options.queue_capacity };
+			page_queue_t framed{ options.queue_capacity };
+			page_queue_t decoded{ options.queue_capacity };
+			text_queue_t encoded{ options.queue_capacity };
+
+			std::thread ingest_thread( [&]( ) {
+				auto & st = stats[0];
+				auto const started = clock_t::now( );
+				daw::trace::set_thread_name( "ingest" );
+				history_page_reader reader{ input };
+				for( int64_t index = 0; ; ++index ) {
+					// Waiting here is the backpressure, every later stage releases memory
+					budget.reserve( pages_memory, history_page_size );
+					auto const start = clock_t::now( );
+					auto batch = std::make_unique<page_batch_t>( );
+					batch->index = index;
+					batch->reserved = 0;
+					bool more = false;
+					{
+						daw::trace::scoped_span const span{ "ingest", "pipeline", "page", index };
+						more = reader.next_raw( batch->bytes );
+					}
+					st.busy += clock_t::now( ) - start;
+					if( !more ) {
+						budget.release( pages_memory, history_page_size );
+						break;
+					}
+					++st.batches;
+					ingested.push( std::move( batch ) );
+				}
+				ingested.close( );
+				st.wall = clock_t::now( ) - started;
+			} );
+
+			std::thread frame_thread( [&]( ) {
+				auto & st = stats[1];
+				auto const started = clock_t::now( );
+				daw::trace::set_thread_name( "frame" );
+				history_framer const framer{ pump_model, options.framing };
+				int64_t resync_bytes = 0;
+				std::vector<cached_record_t> cached;
+				std::unique_ptr<page_batch_t> batch;
+				while( ingested.pop( batch ) ) {
+					timed( st, "frame", batch->index, [&]( ) {
+						auto const page = batch->body( );
+						if( options.cache ) {
+							// Keyed on the page with its CRC, as decode_history_download does
+							auto const raw_page = batch->page( );
+							page_status_t status;
+							if( !options.cache->lookup( raw_page, pump_model, options.framing, cached, status ) ) {
+								status = check_page_crc( raw_page ) ? page_status_t::ok : page_status_t::crc_mismatch;
+								frame_page( page, framer, cached );
+								options.cache->store( raw_page, pump_model, options.framing, cached, status );
+							}
+							for( auto const & rec : cached ) {
+								batch->frames.push_back( to_frame( rec ) );
+								if( rec.kind == history_frame_kind_t::error ) {
+									resync_bytes += rec.size;
+									daw::trace::counter( "resync_bytes", resync_bytes );
+								}
+							}
+							return true;
+						}
+						size_t offset = 0;
+						while( offset < page.size( ) ) {
+							auto const frame = framer.next( page, offset );
+							if( frame.kind != history_frame_kind_t::padding ) {
+								batch->frames.push_back( frame );
+							}
+							if( frame.kind == history_frame_kind_t::error ) {
+								resync_bytes += static_cast<int64_t>(frame.size);
+								daw::trace::counter( "resync_bytes", resync_bytes );
+							}
+							offset += frame.size;
+						}
+						return true;
+					} );
+					framed.push( std::move( batch ) );
+				}
+				framed.close( );
+				st.wall = clock_t::now( ) - started;
+			} );
+
+			std::thread decode_thread( [&]( ) {
+				auto & st = stats[2];
+				auto const started = clock_t::now( );
+				daw::trace::set_thread_name( "decode" );
+				auto const decoder = get_history_decoder( pump_model );
+				std::unique_ptr<page_batch_t> batch;
+				while( framed.pop( batch ) ) {
+					timed( st, "decode", batch->index, [&]( ) {
+						auto const page = batch->body( );
+						batch->entries.reserve( batch->frames.size( ) );
+						for( auto const & frame : batch->frames ) {
+							if( frame.kind == history_frame_kind_t::error ) {
+								batch->entries.emplace_back( );
+								continue;
+							}
+							daw::trace::scoped_span const span{ "create_history_entry", "decode", "op_code", page[frame.offset] };
+							auto data = page.slice( frame.offset );
+							auto position = frame.offset;
+							batch->entries.push_back( decoder( data, pump_model, position ) );
+							if( batch->entries.back( ) ) {
+								batch->reserved += sizeof( history_entry_obj ) + batch->entries.back( )->data( ).size( );
+							}
+						}
+						return true;
+					} );
+					budget.force_reserve( records_memory, batch->reserved );
+					decoded.push( std::move( batch ) );
+				}
+				decoded.close( );
+				st.wall = clock_t::now( ) - started;
+			} );
+
+			std::thread encode_thread( [&]( ) {
+				auto & st = stats[3];
+				auto const started = clock_t::now( );
+				daw::trace::set_thread_name( "encode" );
+				std::unique_ptr<page_batch_t> batch;
+				while( decoded.pop( batch ) ) {
+					auto text = timed( st, "encode", batch->index, [&]( ) {
+						auto const page = batch->body( );
+						std::stringstream ss;
+						for( size_t n = 0; n < batch->frames.size( ); ++n ) {
+							auto const & frame = batch->frames[n];
+							auto const & entry = batch->entries[n];
+							if( !entry ) {
+								ss << frame.offset+1 << "/" << page.size( ) << ": ";
+								ss << "ERROR: data( " << frame.size << " ) { ";
+								ss << page.slice( frame.offset, frame.offset + frame.size ).to_hex_string( ) << " }\n\n";
+								continue;
+							}
+							ss << frame.offset+frame.size+1 << "/" << page.size( ) << ": ";
+							ss << entry->encode( ) << "\n\n";
+						}
+						return ss.str( );
+					} );
+					budget.force_reserve( output_memory, text.size( ) );
+					budget.release( records_memory, batch->reserved );
+					budget.release( pages_memory, history_page_size );
+					batch.reset( );
+					encoded.push( std::move( text ) );
+				}
+				encoded.close( );
+				st.wall = clock_t::now( ) - started;
+			} );
+
+			std::thread write_thread( [&]( ) {
+				auto & st = stats[4];
+				auto const started = clock_t::now( );
+				daw::trace::set_thread_name( "write" );
+				std::string text;
+				int64_t index = 0;
+				while( encoded.pop( text ) ) {
+					timed( st, "write", index++, [&]( ) {
+						output.write( text.data( ), static_cast<std::streamsize>(text.size( )) );
+						return true;
+					} );
+					budget.release( output_memory, text.size( ) );
+				}
+				output.flush( );
+				st.wall = clock_t::now( ) - started;
+			} );
+
+			ingest_thread.join( );
+			frame_thread.join( );
+			decode_thread.join( );
+			encode_thread.join( );
+			write_thread.join( );
+			return stats;
+		}
+	}	// namespace history
+}	// namespace daw
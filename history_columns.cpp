@@ -0,0 +1,165 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <array>
+#include <cassert>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include "history_columns.h"
+#include "history_pages.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			template<typename Entry>
+			Entry const & as( history_entry_obj const & entry ) {
+				assert( dynamic_cast<Entry const *>( &entry ) );
+				return static_cast<Entry const &>( entry );
+			}
+
+			void append_row( history_columns_t & table, std::initializer_list<double> row ) {
+				assert( row.size( ) == table.values.size( ) );
+				auto column = table.values.begin( );
+				for( auto const value : row ) {
+					(column++)->push_back( value );
+				}
+			}
+
+			// Keep in step with history_column_names
+			void append_values( history_entry_obj const & entry, history_columns_t & table ) {
+				switch( entry.op_code( ) ) {
+				case 0x01: {
+					auto const & bolus = as<hist_bolus_normal>( entry );
+					append_row( table, { bolus.m_amount, bolus.m_programmed, bolus.m_unabsorbed_insulin_total, static_cast<double>(bolus.m_duration) } );
+					break;
+				}
+				case 0x03: {
+					auto const & prime = as<hist_prime>( entry );
+					append_row( table, { prime.m_amount, prime.m_programmed_amount } );
+					break;
+				}
+				case 0x0A:
+					append_row( table, { static_cast<double>(as<hist_cal_bg_for_ph>( entry ).m_amount) } );
+					break;
+				case 0x16:
+					append_row( table, { static_cast<double>(as<hist_temp_basal_duration>( entry ).m_duration_minutes) } );
+					break;
+				case 0x33: {
+					auto const & temp_basal = as<hist_temp_basal>( entry );
+					append_row( table, { temp_basal.m_rate, temp_basal.m_rate_type == "percent" ? 1.0 : 0.0 } );
+					break;
+				}
+				case 0x3F:
+					append_row( table, { static_cast<double>(as<hist_bg_received>( entry ).m_amount) } );
+					break;
+				case 0x5B: {
+					auto const & wizard = as<hist_bolus_wizard_estimate>( entry );
+					append_row( table, {
+						static_cast<double>(wizard.m_carbohydrates), static_cast<double>(wizard.m_blood_glucose),
+						wizard.m_insulin_food_estimate, wizard.m_insulin_correction_estimate, wizard.m_insulin_bolus_estimate,
+						wizard.m_unabsorbed_insulin_total, static_cast<double>(wizard.m_bg_target_low), static_cast<double>(wizard.m_bg_target_high),
+						static_cast<double>(wizard.m_insulin_sensitivity), wizard.m_carbohydrate_ratio } );
+					break;
+				}
+				case 0x7B: {
+					auto const & profile_start = as<hist_basal_profile_start>( entry );
+					append_row( table, { profile_start.m_rate, static_cast<double>(profile_start.m_offset/(60*1000)), static_cast<double>(profile_start.m_profile_index) } );
+					break;
+				}
+				default:
+					assert( table.values.empty( ) );
+					break;
+				}
+			}
+		}	// namespace anonymous
+
+		history_columns_t::history_columns_t( uint8_t code ):
+				op_code{ code },
+				timestamps{ },
+				names{ history_column_names( code ) },
+				values( names.size( ) ) { }
+
+		size_t history_columns_t::size( ) const {
+			return timestamps.size( );
+		}
+
+		std::vector<std::string> history_column_names( uint8_t op_code ) {
+			switch( op_code ) {
+			case 0x01: return { "amount", "programmed", "unabsorbed_insulin_total", "duration" };
+			case 0x03: return { "amount", "programmed" };
+			case 0x0A: return { "amount" };
+			case 0x16: return { "duration" };
+			case 0x33: return { "rate", "percent" };
+			case 0x3F: return { "amount" };
+			case 0x5B: return { "carb_input", "bg", "food_estimate", "correction_estimate", "bolus_estimate", "unabsorbed_insulin_total", "bg_target_low", "bg_target_high", "insulin_sensitivity", "carb_ratio" };
+			case 0x7B: return { "rate", "offset", "profile_index" };
+			default: return { };
+			}
+		}
+
+		std::vector<history_columns_t> decode_history_columns( history_download_t const & download, pump_model_t const & pump_model ) {
+			auto const & records = download.records;
+			std::array<size_t, 256> counts{ };
+			for( auto const op_code : records.op_codes ) {
+				++counts[op_code];
+			}
+			std::vector<history_columns_t> result;
+			std::array<size_t, 256> table_index{ };
+			for( size_t op_code = 0; op_code < counts.size( ); ++op_code ) {
+				if( counts[op_code] == 0 ) {
+					continue;
+				}
+				table_index[op_code] = result.size( );
+				result.emplace_back( static_cast<uint8_t>(op_code) );
+				result.back( ).timestamps.reserve( counts[op_code] );
+				for( auto & column : result.back( ).values ) {
+					column.reserve( counts[op_code] );
+				}
+			}
+
+			auto const decoder = get_history_decoder( pump_model );
+			std::vector<uint8_t> record;
+			for( size_t n = 0; n < records.size( ); ++n ) {
+				auto & table = result[table_index[records.op_codes[n]]];
+				table.timestamps.push_back( records.timestamps[n] );
+				if( table.values.empty( ) ) {
+					continue;
+				}
+				// The decoder takes mutable data, the record is copied rather than the download
+				auto const first = records.data.begin( ) + records.data_offsets[n];
+				record.assign( first, first + records.sizes[n] );
+				auto data = daw::range::make_range( record.data( ), record.data( ) + record.size( ) );
+				size_t position = records.offsets[n];
+				auto const entry = decoder( data, pump_model, position );
+				if( !entry ) {
+					for( auto & column : table.values ) {
+						column.push_back( std::numeric_limits<double>::quiet_NaN( ) );
+					}
+					continue;
+				}
+				append_values( *entry, table );
+			}
+			return result;
+		}
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,236 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <array>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			std::array<uint16_t, 256> const & crc16_ccitt_table( ) {
+				static auto const result = []( ) {
+					std::array<uint16_t, 256> table;
+					for( uint16_t n = 0; n < 256; ++n ) {
+						uint16_t crc = static_cast<uint16_t>(n << 8);
+						for( size_t bit = 0; bit < 8; ++bit ) {
+							crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1));
+						}
+						table[n] = crc;
+					}
+					return table;
+				}( );
+				return result;
+			}
+
+			uint16_t current_year( ) {
+				return static_cast<uint16_t>(boost::posix_time::second_clock::local_time( ).date( ).year( ));
+			}
+
+			uint16_t timestamp_year( data_source_t const & data, record_layout_t const & layout ) {
+				switch( layout.timestamp_size ) {
+				case 2:
+					return static_cast<uint16_t>(2000 + (data[layout.timestamp_offset + 1] & 0b01111111));
+				case 5:
+					return static_cast<uint16_t>(2000 + (data[layout.timestamp_offset + 4] & 0b01111111));
+				default:
+					return 0;
+				}
+			}
+
+			history_framer_fn_t get_framer_fn( pump_model_t const & pump_model ) {
+				switch( pump_model.family( ) ) {
+					case pump_family_t::small: return &frame_history_entry<small_pump_traits>;
+					case pump_family_t::large: return &frame_history_entry<large_pump_traits>;
+					case pump_family_t::low_suspend: return &frame_history_entry<low_suspend_pump_traits>;
+				}
+				return nullptr;
+			}
+		}	// namespace anonymous
+
+		uint16_t crc16_ccitt( uint8_t const * first, uint8_t const * last ) noexcept {
+			auto const & table = crc16_ccitt_table( );
+			uint16_t crc = 0xFFFF;
+			for( ; first != last; ++first ) {
+				crc = static_cast<uint16_t>((crc << 8) ^ table[((crc >> 8) ^ *first) & 0xFF]);
+			}
+			return crc;
+		}
+
+		bool check_page_crc( data_source_t const & page ) noexcept {
+			if( page.size( ) < 2 ) {
+				return false;
+			}
+			auto const body_size = page.size( ) - 2;
+			auto const expected = static_cast<uint16_t>((static_cast<uint16_t>(page[body_size]) << 8) | page[body_size + 1]);
+			return crc16_ccitt( page.begin( ), page.begin( ) + body_size ) == expected;
+		}
+
+		int64_t to_epoch_seconds( boost::posix_time::ptime const & ts ) {
+			static boost::posix_time::ptime const epoch{ boost::gregorian::date{ 1970, 1, 1 } };
+			return (ts - epoch).total_seconds( );
+		}
+
+		framing_options_t::framing_options_t( ):
+			min_resync_year{ current_year( ) },
+			max_resync_year{ min_resync_year },
+			max_error_span{ history_page_size } { }
+
+		framing_options_t::framing_options_t( uint16_t min_year, uint16_t max_year, size_t max_error ):
+			min_resync_year{ min_year },
+			max_resync_year{ max_year },
+			max_error_span{ std::max<size_t>( 1, max_error ) } { }
+
+		history_framer::history_framer( pump_model_t const & pump_model, framing_options_t options ):
+			m_frame{ get_framer_fn( pump_model ) },
+			m_options{ std::move( options ) },
+			m_timezone{ pump_model.timezone } { }
+
+		boost::optional<record_layout_t> history_framer::frame( data_source_t const & data ) const {
+			return m_frame( data );
+		}
+
+		timezone_table const * history_framer::timezone( ) const {
+			return m_timezone.get( );
+		}
+
+		bool history_framer::is_resync_point( data_source_t const & data ) const {
+			if( data[0] == 0 ) {
+				return false;
+			}
+			auto const layout = m_frame( data );
+			if( !layout || layout->timestamp_size == 0 || !has_valid_timestamp( data, *layout ) ) {
+				return false;
+			}
+			auto const year = timestamp_year( data, *layout );
+			return year >= m_options.min_resync_year && year <= m_options.max_resync_year;
+		}
+
+		history_frame_t history_framer::next( data_source_t const & buffer, size_t offset ) const {
+			assert( offset < buffer.size( ) );
+			auto const data = buffer.slice( offset );
+			if( data[0] == 0 ) {
+				return history_frame_t{ history_frame_kind_t::padding, offset, 1, record_layout_t{ 1, 0, 0 } };
+			}
+			auto const layout = m_frame( data );
+			if( layout ) {
+				return history_frame_t{ history_frame_kind_t::record, offset, layout->size, *layout };
+			}
+			// Unknown op_code, skip ahead to the next plausible entry
+			size_t end = offset + 1;
+			auto const last = offset + std::min( buffer.size( ) - offset, m_options.max_error_span );
+			while( end < last && !is_resync_point( buffer.slice( end ) ) ) {
+				++end;
+			}
+			return history_frame_t{ history_frame_kind_t::error, offset, end - offset, record_layout_t{ end - offset, 0, 0 } };
+		}
+
+		size_t history_record_table_t::size( ) const {
+			return op_codes.size( );
+		}
+
+		void history_record_table_t::reserve( size_t records, size_t bytes ) {
+			op_codes.reserve( records );
+			timestamps.reserve( records );
+			pages.reserve( records );
+			offsets.reserve( records );
+			sizes.reserve( records );
+			data_offsets.reserve( records );
+			data.reserve( bytes );
+		}
+
+		history_download_t decode_history_download( data_source_t const * first_page, data_source_t const * last_page, pump_model_t const & pump_model, framing_options_t const & options ) {
+			history_download_t result;
+			history_framer const framer{ pump_model, options };
+
+			size_t total_bytes = 0;
+			for( auto page = first_page; page != last_page; ++page ) {
+				total_bytes += page->size( );
+			}
+			// 7 bytes is the most common entry size
+			result.records.reserve( total_bytes/7, total_bytes );
+			result.pages.reserve( static_cast<size_t>(last_page - first_page) );
+
+			auto & records = result.records;
+			for( auto page = first_page; page != last_page; ++page ) {
+				auto const page_index = static_cast<uint32_t>(page - first_page);
+				history_page_status_t status{ page_status_t::ok, 0, 0 };
+				if( page->size( ) < 2 ) {
+					status.status = page_status_t::too_short;
+					result.pages.push_back( status );
+					continue;
+				}
+				if( !check_page_crc( *page ) ) {
+					status.status = page_status_t::crc_mismatch;
+				}
+				auto const body = page->shrink( page->size( ) - 2 );
+				size_t offset = 0;
+				while( offset < body.size( ) ) {
+					auto const frame = framer.next( body, offset );
+					switch( frame.kind ) {
+					case history_frame_kind_t::padding:
+						break;
+					case history_frame_kind_t::record: {
+							auto const data = body.slice( offset, offset + frame.size );
+							auto const ts = parse_history_timestamp( data, frame.layout, framer.timezone( ) );
+							records.op_codes.push_back( data[0] );
+							records.timestamps.push_back( ts ? to_epoch_seconds( *ts ) : no_timestamp );
+							records.pages.push_back( page_index );
+							records.offsets.push_back( static_cast<uint32_t>(offset) );
+							records.sizes.push_back( static_cast<uint32_t>(frame.size) );
+							records.data_offsets.push_back( static_cast<uint32_t>(records.data.size( )) );
+							records.data.insert( records.data.end( ), data.begin( ), data.end( ) );
+							++status.records;
+						}
+						break;
+					case history_frame_kind_t::error:
+						result.errors.push_back( history_error_span_t{ page_index, static_cast<uint32_t>(offset), static_cast<uint32_t>(frame.size) } );
+						status.error_bytes += static_cast<uint32_t>(frame.size);
+						break;
+					}
+					offset += frame.size;
+				}
+				result.pages.push_back( status );
+			}
+			return result;
+		}
+
+		std::vector<data_source_t> split_history_pages( data_source_t download ) {
+			std::vector<data_source_t> result;
+			if( download.size( ) <= history_page_size || download.size( ) % history_page_size != 0 ) {
+				result.push_back( std::move( download ) );
+				return result;
+			}
+			result.reserve( download.size( )/history_page_size );
+			while( !download.at_end( ) ) {
+				result.push_back( download.shrink( history_page_size ) );
+				download.advance( static_cast<data_source_t::difference_type>(history_page_size) );
+			}
+			return result;
+		}
+
+		history_download_t decode_history_download( data_source_t download, pump_model_t const & pump_model, framing_options_t const & options ) {
+			auto const pages = split_history_pages( std::move( download ) );
+			return decode_history_download( pages.data( ), pages.data( ) + pages.size( ), pump_model, options );
+		}
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,212 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include "history_decode.h"
+#include "history_input.h"
+#include "trace.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			int hex_value( char c ) {
+				if( c >= '0' && c <= '9' ) {
+					return c - '0';
+				}
+				if( c >= 'a' && c <= 'f' ) {
+					return c - 'a' + 10;
+				}
+				if( c >= 'A' && c <= 'F' ) {
+					return c - 'A' + 10;
+				}
+				return -1;
+			}
+
+			bool looks_binary( char const * first, char const * last ) {
+				return std::any_of( first, last, []( char c ) {
+					return hex_value( c ) < 0 && !std::isspace( static_cast<unsigned char>(c) );
+				} );
+			}
+		}	// namespace anonymous
+
+		std::string to_string( input_compression_t compression ) {
+			switch( compression ) {
+			case input_compression_t::none: return "none";
+			case input_compression_t::gzip: return "gzip";
+			case input_compression_t::zstd: return "zstd";
+			case input_compression_t::bzip2: return "bzip2";
+			}
+			return "unknown";
+		}
+
+		input_compression_t detect_compression( std::istream & input ) {
+			std::array<unsigned char, 4> magic{ { 0, 0, 0, 0 } };
+			auto const position = input.tellg( );
+			input.read( reinterpret_cast<char *>(magic.data( )), static_cast<std::streamsize>(magic.size( )) );
+			auto const count = input.gcount( );
+			input.clear( );
+			input.seekg( position );
+			if( count >= 2 && magic[0] == 0x1F && magic[1] == 0x8B ) {
+				return input_compression_t::gzip;
+			}
+			if( count >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD ) {
+				return input_compression_t::zstd;
+			}
+			if( count >= 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h' ) {
+				return input_compression_t::bzip2;
+			}
+			return input_compression_t::none;
+		}
+
+		history_input_file::history_input_file( std::string const & file_name, size_t buffer_size ):
+			m_file( file_name.c_str( ), std::ios::binary ),
+			m_stream{ },
+			m_compression{ input_compression_t::none } {
+
+			if( !m_file ) {
+				return;
+			}
+			m_compression = detect_compression( m_file );
+			namespace io = boost::iostreams;
+			auto const size = static_cast<std::streamsize>(buffer_size);
+			switch( m_compression ) {
+			case input_compression_t::gzip:
+				m_stream.push( io::gzip_decompressor{ io::gzip::default_window_bits, size }, size );
+				break;
+			case input_compression_t::zstd:
+				m_stream.push( io::zstd_decompressor{ size }, size );
+				break;
+			case input_compression_t::bzip2:
+				m_stream.push( io::bzip2_decompressor{ false, size }, size );
+				break;
+			case input_compression_t::none:
+				break;
+			}
+			m_stream.push( m_file, size );
+		}
+
+		history_input_file::~history_input_file( ) { }
+
+		bool history_input_file::is_open( ) const {
+			return m_file.is_open( );
+		}
+
+		input_compression_t history_input_file::compression( ) const {
+			return m_compression;
+		}
+
+		std::istream & history_input_file::stream( ) {
+			return m_stream;
+		}
+
+		hex_decoder::hex_decoder( ):
+			m_high{ -1 } { }
+
+		void hex_decoder::feed( char const * first, char const * last, std::vector<uint8_t> & out ) {
+			for( ; first != last; ++first ) {
+				auto const value = hex_value( *first );
+				if( value < 0 ) {
+					continue;
+				}
+				if( m_high < 0 ) {
+					m_high = value;
+				} else {
+					out.push_back( static_cast<uint8_t>((m_high << 4) | value) );
+					m_high = -1;
+				}
+			}
+		}
+
+		history_page_reader::history_page_reader( std::istream & input, size_t buffer_size, input_encoding_t encoding ):
+			m_input{ &input },
+			m_hex{ },
+			m_encoding{ encoding },
+			m_buffer( buffer_size ),
+			m_pending{ },
+			m_start{ 0 },
+			m_eof{ false } { }
+
+		size_t history_page_reader::pending( ) const {
+			return m_pending.size( ) - m_start;
+		}
+
+		void history_page_reader::fill( size_t bytes ) {
+			if( m_start > 0 && pending( ) < bytes ) {
+				m_pending.erase( m_pending.begin( ), m_pending.begin( ) + static_cast<std::ptrdiff_t>(m_start) );
+				m_start = 0;
+			}
+			while( !m_eof && pending( ) < bytes ) {
+				std::streamsize count = 0;
+				{
+					daw::trace::scoped_span const span{ "read", "input" };
+					m_input->read( m_buffer.data( ), static_cast<std::streamsize>(m_buffer.size( )) );
+					count = m_input->gcount( );
+				}
+				if( count <= 0 ) {
+					m_eof = true;
+					break;
+				}
+				auto const first = m_buffer.data( );
+				auto const last = first + count;
+				if( m_encoding == input_encoding_t::automatic ) {
+					m_encoding = looks_binary( first, last ) ? input_encoding_t::binary : input_encoding_t::hex;
+				}
+				if( m_encoding == input_encoding_t::binary ) {
+					m_pending.insert( m_pending.end( ), reinterpret_cast<uint8_t const *>(first), reinterpret_cast<uint8_t const *>(last) );
+				} else {
+					daw::trace::scoped_span const span{ "hex", "input" };
+					m_hex.feed( first, last, m_pending );
+				}
+			}
+		}
+
+		bool history_page_reader::next_raw( std::vector<uint8_t> & page ) {
+			fill( history_page_size );
+			auto const first = m_pending.begin( ) + static_cast<std::ptrdiff_t>(m_start);
+			auto const size = std::min( pending( ), history_page_size );
+			page.assign( first, first + static_cast<std::ptrdiff_t>(size) );
+			m_start += size;
+			if( page.size( ) < 3 ) {
+				page.clear( );
+				return false;
+			}
+			return true;
+		}
+
+		bool history_page_reader::next( std::vector<uint8_t> & page ) {
+			if( !next_raw( page ) ) {
+				return false;
+			}
+			page.resize( page.size( ) - 2 );	// crc
+			return true;
+		}
+
+		input_encoding_t history_page_reader::encoding( ) const {
+			return m_encoding;
+		}
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,207 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <tuple>
+#include "history_merge.h"
+#include "history_range.h"
+
+namespace daw {
+	namespace history {
+		uint64_t hash_history_data( uint8_t const * data, size_t size ) noexcept {
+			uint64_t result = 14695981039346656037ull;
+			for( size_t n = 0; n < size; ++n ) {
+				result ^= data[n];
+				result *= 1099511628211ull;
+			}
+			return result;
+		}
+
+		uint64_t hash_history_data( std::vector<uint8_t> const & data ) noexcept {
+			return hash_history_data( data.data( ), data.size( ) );
+		}
+
+		history_key_t::history_key_t( history_entry_obj const & entry, boost::posix_time::ptime ts ):
+			op_code{ entry.op_code( ) },
+			timestamp{ std::move( ts ) },
+			data_hash{ hash_history_data( entry.data( ) ) } { }
+
+		history_key_t::history_key_t( uint8_t op, boost::posix_time::ptime ts, uint64_t hash ):
+			op_code{ op },
+			timestamp{ std::move( ts ) },
+			data_hash{ hash } { }
+
+		bool operator==( history_key_t const & lhs, history_key_t const & rhs ) noexcept {
+			return lhs.op_code == rhs.op_code && lhs.data_hash == rhs.data_hash && lhs.timestamp == rhs.timestamp;
+		}
+
+		size_t history_key_hash_t::operator( )( history_key_t const & key ) const noexcept {
+			// the raw data hash covers the timestamp bytes already
+			return static_cast<size_t>(key.data_hash ^ (static_cast<uint64_t>(key.op_code) << 56));
+		}
+
+		history_merge::history_merge( boost::posix_time::time_duration window ):
+			m_streams{ },
+			m_heads{ },
+			m_heap{ },
+			m_window{ std::move( window ) },
+			m_seen{ },
+			m_seen_order{ },
+			m_duplicates{ 0 },
+			m_started{ false } { }
+
+		history_merge::~history_merge( ) { }
+
+		void history_merge::add_stream( history_stream_t stream ) {
+			assert( !m_started );
+			m_streams.push_back( std::move( stream ) );
+		}
+
+		bool history_merge::pull( size_t stream_index ) {
+			auto & head = m_heads[stream_index];
+			auto entry = m_streams[stream_index]( );
+			if( !entry ) {
+				head.entry.reset( );
+				return false;
+			}
+			// Entries without a timestamp stay with the record before them in the same stream
+			if( entry->timestamp( ) ) {
+				head.timestamp = *entry->timestamp( );
+			}
+			head.entry = std::move( entry );
+			return true;
+		}
+
+		bool history_merge::is_later( size_t lhs, size_t rhs ) const {
+			// ties go to the lower stream index so the merge is stable
+			return std::tie( m_heads[lhs].timestamp, lhs ) > std::tie( m_heads[rhs].timestamp, rhs );
+		}
+
+		void history_merge::start( ) {
+			m_started = true;
+			m_heads.resize( m_streams.size( ) );
+			for( size_t n = 0; n < m_streams.size( ); ++n ) {
+				m_heads[n].timestamp = boost::posix_time::ptime{ boost::posix_time::min_date_time };
+				if( pull( n ) ) {
+					m_heap.push_back( n );
+				}
+			}
+			std::make_heap( m_heap.begin( ), m_heap.end( ), [this]( size_t lhs, size_t rhs ) { return is_later( lhs, rhs ); } );
+		}
+
+		void history_merge::evict( boost::posix_time::ptime const & now ) {
+			while( !m_seen_order.empty( ) && m_seen_order.front( ).timestamp + m_window < now ) {
+				m_seen.erase( m_seen_order.front( ) );
+				m_seen_order.pop_front( );
+			}
+		}
+
+		std::unique_ptr<history_entry_obj> history_merge::next( ) {
+			if( !m_started ) {
+				start( );
+			}
+			auto const heap_compare = [this]( size_t lhs, size_t rhs ) { return is_later( lhs, rhs ); };
+			while( !m_heap.empty( ) ) {
+				std::pop_heap( m_heap.begin( ), m_heap.end( ), heap_compare );
+				auto const stream_index = m_heap.back( );
+				auto entry = std::move( m_heads[stream_index].entry );
+				history_key_t key{ *entry, m_heads[stream_index].timestamp };
+
+				if( pull( stream_index ) ) {
+					std::push_heap( m_heap.begin( ), m_heap.end( ), heap_compare );
+				} else {
+					m_heap.pop_back( );
+				}
+
+				evict( key.timestamp );
+				if( !m_seen.insert( key ).second ) {
+					++m_duplicates;
+					continue;
+				}
+				m_seen_order.push_back( std::move( key ) );
+				return entry;
+			}
+			return nullptr;
+		}
+
+		size_t history_merge::duplicates( ) const {
+			return m_duplicates;
+		}
+
+		size_t history_merge::window_size( ) const {
+			return m_seen.size( );
+		}
+
+		history_stream_t make_history_stream( std::vector<std::unique_ptr<history_entry_obj>> entries ) {
+			auto items = std::make_shared<std::vector<std::unique_ptr<history_entry_obj>>>( std::move( entries ) );
+			auto pos = std::make_shared<size_t>( 0 );
+			return [items, pos]( ) -> std::unique_ptr<history_entry_obj> {
+				if( *pos >= items->size( ) ) {
+					return nullptr;
+				}
+				return std::move( (*items)[(*pos)++] );
+			};
+		}
+
+		history_stream_t make_download_stream( data_source_t download, pump_model_t const & pump_model ) {
+			struct page_t {
+				boost::posix_time::ptime first_timestamp;
+				std::vector<std::unique_ptr<history_entry_obj>> entries;
+			};
+			std::vector<page_t> pages;
+			for( auto && rec : decode( download, pump_model ) ) {
+				if( rec.is_error( ) ) {
+					continue;
+				}
+				auto entry = rec.decode( );
+				if( !entry ) {
+					continue;
+				}
+				auto const page = rec.offset( )/(history_page_size - 2);
+				if( pages.size( ) <= page ) {
+					pages.resize( page + 1 );
+				}
+				auto & current = pages[page];
+				if( current.first_timestamp.is_not_a_date_time( ) && entry->timestamp( ) ) {
+					current.first_timestamp = *entry->timestamp( );
+				}
+				current.entries.push_back( std::move( entry ) );
+			}
+			// A page without a timestamp stays after the page before it in the download
+			for( size_t n = 0; n < pages.size( ); ++n ) {
+				if( pages[n].first_timestamp.is_not_a_date_time( ) ) {
+					pages[n].first_timestamp = n == 0 ? boost::posix_time::ptime{ boost::posix_time::neg_infin } : pages[n - 1].first_timestamp;
+				}
+			}
+			std::stable_sort( pages.begin( ), pages.end( ), []( page_t const & lhs, page_t const & rhs ) {
+				return lhs.first_timestamp < rhs.first_timestamp;
+			} );
+			std::vector<std::unique_ptr<history_entry_obj>> entries;
+			for( auto & page : pages ) {
+				std::move( page.entries.begin( ), page.entries.end( ), std::back_inserter( entries ) );
+			}
+			return make_history_stream( std::move( entries ) );
+		}
+	}	// namespace history
+}	// namespace daw
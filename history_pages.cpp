@@ -25,33 +25,32 @@
 #include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/optional.hpp>
 #include <daw/daw_range.h>
+#include <array>
 #include <sstream>
 #include <tuple>
 #include <daw/json/daw_json.h>
 #include <daw/json/daw_json_link.h>
 #include "history_pages.h"
+#include "timezone.h"
 
 namespace daw {
 	namespace history {
-			namespace {
-			
-			uint32_t seconds_from_gmt( ) {
+		int32_t seconds_from_gmt( ) {
 #ifdef WIN32
 #pragma message ("Warning: GMT Offset set to 0 seconds")
-				return 0;
+			return 0;
 #else
-				static auto const result = []( ) { 
-					time_t t = time( nullptr );
-					struct tm lt = { };
-					localtime_r( &t, &lt );
-					
-					return lt.tm_gmtoff;
-				}( );
-				return static_cast<uint32_t>(result);
+			static auto const result = []( ) { 
+				time_t t = time( nullptr );
+				struct tm lt = { };
+				localtime_r( &t, &lt );
+				
+				return lt.tm_gmtoff;
+			}( );
+			return static_cast<int32_t>(result);
 #endif
-			}
+		}
 
-		}	// namespace anonymous
 		std::string op_string( uint8_t op_code ) {
 			switch( op_code ) {
 				case 0x00: return "skip";
@@ -121,7 +120,7 @@ namespace daw {
 
 		namespace {
 			template<typename Container>
-			boost::optional<boost::posix_time::ptime> parse_timestamp( Container const & arry ) noexcept {
+			boost::optional<boost::posix_time::ptime> parse_timestamp( Container const & arry, timezone_table const * zone ) noexcept {
 				if( arry.size( ) < 5 ) {
 					return boost::optional<boost::posix_time::ptime>{ };
 				}
@@ -132,21 +131,16 @@ namespace daw {
 				uint8_t  month = ((arry[0] >> 4) & 0b00001100) + (arry[1] >> 6);
 				uint16_t  year = 2000 + (arry[4] & 0b01111111);
 				if( day < 1 || day > 31 || month < 1 || month > 12 || hour > 24 || minute > 59 || second > 60 ) {
-					std::cerr << "WARNING: Could not parse timestamp year=" << static_cast<int>(year) << " month=" << static_cast<int>(month)
-							<< " day=" << static_cast<int>(day) << " hour=" << static_cast<int>(hour) << " minute=" << static_cast<int>(minute)
-							<< " second=" << static_cast<int>(second) << "\n";
 					return boost::optional<boost::posix_time::ptime>{ };
 				}
 				try {
 					using namespace boost::posix_time;
 					using namespace boost::gregorian;
 					ptime result { date { year, month, day }, time_duration { hour, minute, second } };
-					result = result - seconds( seconds_from_gmt( ) ); 
+					auto const local_seconds = (result - ptime{ date{ 1970, 1, 1 } }).total_seconds( );
+					result = result - seconds( utc_offset_at_local( zone, local_seconds ) );
 					return result;
 				} catch( ... ) {
-					std::cerr << "WARNING: Could not parse timestamp year=" << static_cast<int>(year) << " month=" << static_cast<int>(month)
-							<< " day=" << static_cast<int>(day) << " hour=" << static_cast<int>(hour) << " minute=" << static_cast<int>(minute)
-							<< " second=" << static_cast<int>(second) << "\n";
 					return boost::optional<boost::posix_time::ptime>{ };
 				}
 			}
@@ -164,8 +158,6 @@ namespace daw {
 				using namespace boost::posix_time;
 				using namespace boost::gregorian;
 				if( day < 1 || day > 31 || month < 1 || month > 12 ) {
-					std::cerr << "WARNING: Could not parse date year=" << static_cast<int>(year) << " month=" << static_cast<int>(month)
-							<< " day=" << static_cast<int>(day) << "\n";
 					return boost::optional<boost::posix_time::ptime>{ };
 				}
 				try {
@@ -174,21 +166,19 @@ namespace daw {
 					ptime result { date { year, month, day } };
 					return result;
 				} catch( ... ) {
-					std::cerr << "WARNING: Could not parse date year=" << static_cast<int>(year) << " month=" << static_cast<int>(month)
-							<< " day=" << static_cast<int>(day) << "\n";
 					return boost::optional<boost::posix_time::ptime>{ };
 				}
 			}
 
 			template<typename Container>
-			boost::optional<boost::posix_time::ptime> parse_timestamp_in_array( Container const & data, size_t ts_offset, size_t ts_size ) noexcept {
+			boost::optional<boost::posix_time::ptime> parse_timestamp_in_array( Container const & data, size_t ts_offset, size_t ts_size, timezone_table const * zone ) noexcept {
 				boost::optional<boost::posix_time::ptime> result{ };	
 				switch( ts_size ) {
 				case 2:
 					result = parse_date( data.slice( ts_offset ) );
 					break;
 				case 5:
-					result = parse_timestamp( data.slice( ts_offset ) );
+					result = parse_timestamp( data.slice( ts_offset ), zone );
 					break;
 				}
 				return result;
@@ -218,14 +208,21 @@ namespace daw {
 
 		pump_model_t::~pump_model_t( ) { }
 
-		history_entry_obj::history_entry_obj( data_source_t data, bool is_decoded, size_t data_size, pump_model_t, size_t timestamp_offset, size_t timestamp_size ):
+		pump_family_t pump_model_t::family( ) const {
+			if( has_low_suspend ) {
+				return pump_family_t::low_suspend;
+			}
+			return larger ? pump_family_t::large : pump_family_t::small;
+		}
+
+		history_entry_obj::history_entry_obj( data_source_t data, bool is_decoded, size_t data_size, pump_model_t pump_model, size_t timestamp_offset, size_t timestamp_size ):
 			JsonLink<history_entry_obj>( op_string( data[0] ) ),
 			m_op_code { data[0] },
 			m_size { data_size }, 
 			m_timestamp_offset { timestamp_offset },
 			m_timestamp_size { timestamp_size },
 			m_data { data.shrink( data_size ).as_vector( ) },
-			m_timestamp{ parse_timestamp_in_array( data, m_timestamp_offset, m_timestamp_size ) } {
+			m_timestamp{ parse_timestamp_in_array( data, m_timestamp_offset, m_timestamp_size, pump_model.timezone.get( ) ) } {
 				
 				link_integral( "op_code", m_op_code );
 				if( !is_decoded ) {
@@ -285,18 +282,19 @@ namespace daw {
 				return result;
 			}
 
-			template<typename Container>
-			double decode_insulin_from_bytes( Container const & c, pump_model_t const & pm ) {
-				return static_cast<double>(bigendian_to_native_from_bytes<uint16_t>( c, pm.larger ? 2 : 1 ))/static_cast<double>(pm.strokes_per_unit);
+			template<typename Traits, typename Container>
+			double decode_insulin_from_bytes( Container const & c ) {
+				return static_cast<double>(bigendian_to_native_from_bytes<uint16_t>( c, Traits::larger ? 2 : 1 ))/static_cast<double>(Traits::strokes_per_unit);
 			}
 		}
 
-		hist_bolus_normal::hist_bolus_normal( data_source_t data, pump_model_t pump_model ):
-				history_entry<0x01>( std::move( data ), false, pump_model.larger ? 13 : 9, std::move( pump_model ), pump_model.larger ? 8 : 4 ),
-				m_amount{ decode_insulin_from_bytes( data.slice( 3 ), pump_model ) }, 
-				m_programmed{ decode_insulin_from_bytes( data.slice( 1 ), pump_model ) },
-				m_unabsorbed_insulin_total{ pump_model.larger ? decode_insulin_from_bytes( data.slice( 5 ), pump_model ) : 0 },
-				m_duration( static_cast<uint16_t>(data[pump_model.larger ? 7 : 3])*30 ) {
+		template<typename Traits>
+		hist_bolus_normal::hist_bolus_normal( data_source_t data, pump_model_t pump_model, Traits ):
+				history_entry<0x01>( data, false, layout<Traits>( data ).size, std::move( pump_model ), layout<Traits>( data ).timestamp_offset ),
+				m_amount{ decode_insulin_from_bytes<Traits>( data.slice( 3 ) ) }, 
+				m_programmed{ decode_insulin_from_bytes<Traits>( data.slice( 1 ) ) },
+				m_unabsorbed_insulin_total{ Traits::larger ? decode_insulin_from_bytes<Traits>( data.slice( 5 ) ) : 0 },
+				m_duration( static_cast<uint16_t>(data[Traits::larger ? 7 : 3])*30 ) {
 
 			link_real( "amount", m_amount );
 			link_real( "programmed", m_programmed );
@@ -328,8 +326,9 @@ namespace daw {
 
 		hist_alarm_pump::~hist_alarm_pump( ) { }
 
-		hist_result_daily_total::hist_result_daily_total( data_source_t data, pump_model_t pump_model ):
-				history_entry<0x07>( std::move( data ), false, pump_model.larger ? 10 : 7, std::move( pump_model ), 5, 2 ) {
+		template<typename Traits>
+		hist_result_daily_total::hist_result_daily_total( data_source_t data, pump_model_t pump_model, Traits ):
+				history_entry<0x07>( data, false, layout<Traits>( data ).size, std::move( pump_model ), 5, 2 ) {
 
 		}
 
@@ -372,8 +371,8 @@ namespace daw {
 		hist_temp_basal_duration::~hist_temp_basal_duration( ) { }
 
 		hist_change_time::hist_change_time( data_source_t data, pump_model_t pump_model ):
-				history_entry_static<0x17, false, 14, 9>{ std::move( data ), std::move( pump_model ) },
-				m_old_timestamp{ *parse_timestamp( data.slice( 2 ) ) } {
+				history_entry_static<0x17, false, 14, 9>{ std::move( data ), pump_model },
+				m_old_timestamp{ parse_timestamp( data.slice( 2 ), pump_model.timezone.get( ) ) } {
 
 			link_timestamp( "oldTimeStamp", m_old_timestamp );
 		}
@@ -408,11 +407,65 @@ namespace daw {
 
 
 
-		hist_change_sensor_setup::hist_change_sensor_setup( data_source_t data, pump_model_t pump_model ):
-			history_entry<0x50>( std::move( data ), false, pump_model.has_low_suspend ? 41 : 37, std::move( pump_model ) ) { }
+		basal_rate_t::~basal_rate_t( ) { }
+
+		basal_rate_t::basal_rate_t( uint16_t offset, double rate ):
+			daw::json::JsonLink<basal_rate_t>{ },
+			m_offset{ offset },
+			m_rate{ rate } {
+
+			link_integral( "offset", m_offset );
+			link_real( "rate", m_rate );
+		}
+
+		template<uint8_t child_op_code>
+		hist_change_basal_profile_entry<child_op_code>::~hist_change_basal_profile_entry( ) { }
+
+		template<uint8_t child_op_code>
+		hist_change_basal_profile_entry<child_op_code>::hist_change_basal_profile_entry( data_source_t data, pump_model_t pump_model ):
+				history_entry_static<child_op_code, true, 152>{ data, std::move( pump_model ) },
+				m_rates{ } {
+
+			for( size_t n = 0; n < 48; ++n ) {
+				auto const pos = 7 + n*3;
+				if( n > 0 && data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 0 ) {
+					break;
+				}
+				auto const strokes = static_cast<uint16_t>((static_cast<uint16_t>(data[pos + 2] & 0b00000001) << 8) | static_cast<uint16_t>(data[pos + 1]));
+				m_rates.emplace_back( static_cast<uint16_t>(data[pos] * 30), static_cast<double>(strokes)/40.0 );
+			}
+			this->link_array( "rates", m_rates );
+		}
+
+		template struct hist_change_basal_profile_entry<0x08>;
+		template struct hist_change_basal_profile_entry<0x09>;
+
+		template<typename Traits>
+		hist_change_sensor_setup::hist_change_sensor_setup( data_source_t data, pump_model_t pump_model, Traits ):
+				history_entry<0x50>( data, true, layout<Traits>( data ).size, std::move( pump_model ) ),
+				m_enabled{ static_cast<uint8_t>(data[7] & 0b00000001) },
+				m_high_alert{ static_cast<uint8_t>((data[7] >> 1) & 0b00000001) },
+				m_low_alert{ static_cast<uint8_t>((data[7] >> 2) & 0b00000001) },
+				m_high_limit{ bigendian_to_native_from_bytes<uint16_t>( data.slice( 8 ) ) },
+				m_low_limit{ bigendian_to_native_from_bytes<uint16_t>( data.slice( 10 ) ) },
+				m_calibration_reminder{ bigendian_to_native_from_bytes<uint16_t>( data.slice( 12 ) ) },
+				m_transmitter_id{ (static_cast<uint32_t>(data[14]) << 16) | (static_cast<uint32_t>(data[15]) << 8) | static_cast<uint32_t>(data[16]) },
+				m_low_suspend{ static_cast<uint8_t>(Traits::has_low_suspend ? data[37] & 0b00000001 : 0) },
+				m_low_suspend_limit{ Traits::has_low_suspend ? bigendian_to_native_from_bytes<uint16_t>( data.slice( 38 ) ) : static_cast<uint16_t>(0) } {
+
+			link_integral( "enabled", m_enabled );
+			link_integral( "highAlert", m_high_alert );
+			link_integral( "lowAlert", m_low_alert );
+			link_integral( "highLimit", m_high_limit );
+			link_integral( "lowLimit", m_low_limit );
+			link_integral( "calibrationReminder", m_calibration_reminder );
+			link_integral( "transmitterId", m_transmitter_id );
+			if( Traits::has_low_suspend ) {
+				link_integral( "lowSuspend", m_low_suspend );
+				link_integral( "lowSuspendLimit", m_low_suspend_limit );
+			}
+		}
 
-		hist_change_bolus_wizard_setup::hist_change_bolus_wizard_setup( data_source_t data, pump_model_t pump_model ):
-			history_entry<0x5A>( std::move( data ), false, pump_model.larger ? 144 : 124, std::move( pump_model ) ) { }
 
 		namespace {
 			auto bolus_wizard_insulin_decoder( uint8_t a, uint8_t b ) {
@@ -437,18 +490,117 @@ namespace daw {
 
 		}
 	
-		hist_bolus_wizard_estimate::hist_bolus_wizard_estimate( data_source_t data, pump_model_t pump_model ):
-				history_entry<0x5B> { std::move( data ), true, static_cast<size_t>(pump_model.larger ? 22 : 20), pump_model },
-				m_carbohydrates{ pump_model.larger ? static_cast<uint16_t>((static_cast<uint16_t>(data[8] & 0b00001100) << static_cast<uint16_t>(6)) | static_cast<uint16_t>(data[7])) : static_cast<uint16_t>(data[7]) },
+		carb_ratio_t::~carb_ratio_t( ) { }
+
+		carb_ratio_t::carb_ratio_t( uint16_t offset, double ratio ):
+			daw::json::JsonLink<carb_ratio_t>{ },
+			m_offset{ offset },
+			m_ratio{ ratio } {
+
+			link_integral( "offset", m_offset );
+			link_real( "ratio", m_ratio );
+		}
+
+		insulin_sensitivity_t::~insulin_sensitivity_t( ) { }
+
+		insulin_sensitivity_t::insulin_sensitivity_t( uint16_t offset, uint16_t sensitivity ):
+			daw::json::JsonLink<insulin_sensitivity_t>{ },
+			m_offset{ offset },
+			m_sensitivity{ sensitivity } {
+
+			link_integral( "offset", m_offset );
+			link_integral( "sensitivity", m_sensitivity );
+		}
+
+		bg_target_t::~bg_target_t( ) { }
+
+		bg_target_t::bg_target_t( uint16_t offset, uint16_t low, uint16_t high ):
+			daw::json::JsonLink<bg_target_t>{ },
+			m_offset{ offset },
+			m_low{ low },
+			m_high{ high } {
+
+			link_integral( "offset", m_offset );
+			link_integral( "low", m_low );
+			link_integral( "high", m_high );
+		}
+
+		bolus_wizard_settings_t::~bolus_wizard_settings_t( ) { }
+
+		bolus_wizard_settings_t::bolus_wizard_settings_t( ):
+				daw::json::JsonLink<bolus_wizard_settings_t>{ },
+				m_carb_units{ 0 },
+				m_bg_units{ 0 },
+				m_carb_ratios{ },
+				m_sensitivities{ },
+				m_bg_targets{ },
+				m_insulin_action_hours{ 0 } {
+
+			link_integral( "carbUnits", m_carb_units );
+			link_integral( "bgUnits", m_bg_units );
+			link_array( "carbRatios", m_carb_ratios );
+			link_array( "sensitivities", m_sensitivities );
+			link_array( "bgTargets", m_bg_targets );
+			link_integral( "insulinActionHours", m_insulin_action_hours );
+		}
+
+		// A schedule slot past the first with a zero offset is unused, offsets only increase
+		template<typename Traits>
+		bolus_wizard_settings_t::bolus_wizard_settings_t( uint8_t const * first, Traits ):
+				bolus_wizard_settings_t{ } {
+
+			m_carb_units = first[0];
+			m_bg_units = first[1];
+			auto pos = first + 2;
+			size_t const carb_ratio_size = Traits::larger ? 3 : 2;
+			for( size_t n = 0; n < 8; ++n, pos += carb_ratio_size ) {
+				if( n > 0 && pos[0] == 0 ) {
+					continue;
+				}
+				auto const ratio = Traits::larger ? bolus_wizard_carb_ratio_decoder( pos[1], pos[2] ) : static_cast<double>(pos[1]);
+				m_carb_ratios.emplace_back( static_cast<uint16_t>(pos[0] * 30), ratio );
+			}
+			for( size_t n = 0; n < 8; ++n, pos += 2 ) {
+				if( n > 0 && pos[0] == 0 ) {
+					continue;
+				}
+				m_sensitivities.emplace_back( static_cast<uint16_t>(pos[0] * 30), pos[1] );
+			}
+			for( size_t n = 0; n < 8; ++n, pos += 3 ) {
+				if( n > 0 && pos[0] == 0 ) {
+					continue;
+				}
+				m_bg_targets.emplace_back( static_cast<uint16_t>(pos[0] * 30), pos[1], pos[2] );
+			}
+			if( Traits::larger ) {
+				m_insulin_action_hours = pos[0];
+			}
+		}
+
+		template<typename Traits>
+		hist_change_bolus_wizard_setup::hist_change_bolus_wizard_setup( data_source_t data, pump_model_t pump_model, Traits ):
+				history_entry<0x5A>( data, true, layout<Traits>( data ).size, std::move( pump_model ) ),
+				m_old_settings{ data.begin( ) + 7, Traits{ } },
+				m_new_settings{ data.begin( ) + 7 + bolus_wizard_settings_t::size<Traits>( ), Traits{ } } {
+
+			link_object( "oldSettings", m_old_settings );
+			link_object( "newSettings", m_new_settings );
+		}
+
+		// Traits::larger is a constant expression, the unused branch of each field is never emitted
+		template<typename Traits>
+		hist_bolus_wizard_estimate::hist_bolus_wizard_estimate( data_source_t data, pump_model_t pump_model, Traits ):
+				history_entry<0x5B> { data, true, layout<Traits>( data ).size, std::move( pump_model ) },
+				m_carbohydrates{ Traits::larger ? static_cast<uint16_t>((static_cast<uint16_t>(data[8] & 0b00001100) << static_cast<uint16_t>(6)) | static_cast<uint16_t>(data[7])) : static_cast<uint16_t>(data[7]) },
 				m_blood_glucose{ static_cast<uint16_t>(static_cast<uint16_t>(static_cast<uint16_t>(data[8] & 0b00000011) << 8) | static_cast<uint16_t>(data[1])) },
-				m_insulin_food_estimate{ pump_model.larger ? bolus_wizard_insulin_decoder( data[14], data[15] ) : bolus_wizard_insulin_decoder( data[13] ) },
-				m_insulin_correction_estimate{ pump_model.larger ? bolus_wizard_correction_decoder_lrg( data[16], data[13] ) : bolus_wizard_correction_decoder( data[14], data[12] ) } ,
-				m_insulin_bolus_estimate{ pump_model.larger ? bolus_wizard_insulin_decoder( data[19], data[20] ) : bolus_wizard_insulin_decoder( data[18] ) },
-				m_unabsorbed_insulin_total{ pump_model.larger ? bolus_wizard_insulin_decoder( data[17], data[18] ) : bolus_wizard_insulin_decoder( data[16] ) },
-				m_bg_target_low{ pump_model.larger ? data[12] : data[11] },
-				m_bg_target_high{ pump_model.larger ? data[21] : data[19] },
-				m_insulin_sensitivity{ pump_model.larger ? data[11] : data[10] },
-				m_carbohydrate_ratio{ pump_model.larger ? bolus_wizard_carb_ratio_decoder( data[9], data[10] ) : static_cast<double>(data[9]) } {
+				m_insulin_food_estimate{ Traits::larger ? bolus_wizard_insulin_decoder( data[14], data[15] ) : bolus_wizard_insulin_decoder( data[13] ) },
+				m_insulin_correction_estimate{ Traits::larger ? bolus_wizard_correction_decoder_lrg( data[16], data[13] ) : bolus_wizard_correction_decoder( data[14], data[12] ) } ,
+				m_insulin_bolus_estimate{ Traits::larger ? bolus_wizard_insulin_decoder( data[19], data[20] ) : bolus_wizard_insulin_decoder( data[18] ) },
+				m_unabsorbed_insulin_total{ Traits::larger ? bolus_wizard_insulin_decoder( data[17], data[18] ) : bolus_wizard_insulin_decoder( data[16] ) },
+				m_bg_target_low{ Traits::larger ? data[12] : data[11] },
+				m_bg_target_high{ Traits::larger ? data[21] : data[19] },
+				m_insulin_sensitivity{ Traits::larger ? data[11] : data[10] },
+				m_carbohydrate_ratio{ Traits::larger ? bolus_wizard_carb_ratio_decoder( data[9], data[10] ) : static_cast<double>(data[9]) } {
 
 			link_integral( "carbInput", m_carbohydrates );
 			link_integral( "bg", m_blood_glucose );
@@ -478,12 +630,10 @@ namespace daw {
 			m_records{ } {
 				
 				{
-					uint8_t num_records = data[1]; 
-					if( num_records >= 5 ) {
-						num_records = (num_records - 2)/2;
-						for( uint8_t n = 0; n<num_records; ++n ) {
-							m_records.emplace_back( static_cast<double>(data[2+(n*3)])/40.0, data[3+(n*3)] + ((data[4+(n*3)] & 0b110000) << 4) );
-						}
+					// 3 byte records follow the op_code and length, all within the entry
+					size_t const num_records = data[1] >= 5 ? (static_cast<size_t>(data[1]) - 2)/3 : 0;
+					for( size_t n = 0; n<num_records; ++n ) {
+						m_records.emplace_back( static_cast<double>(data[2+(n*3)])/40.0, data[3+(n*3)] + ((data[4+(n*3)] & 0b110000) << 4) );
 					}
 				}
 				link_array( "records", m_records );	
@@ -506,80 +656,121 @@ namespace daw {
 			link_string( "timeFormat", m_time_format );
 		}
 			
+		template hist_bolus_normal::hist_bolus_normal( data_source_t, pump_model_t, small_pump_traits );
+		template hist_bolus_normal::hist_bolus_normal( data_source_t, pump_model_t, large_pump_traits );
+		template hist_bolus_normal::hist_bolus_normal( data_source_t, pump_model_t, low_suspend_pump_traits );
+		template hist_result_daily_total::hist_result_daily_total( data_source_t, pump_model_t, small_pump_traits );
+		template hist_result_daily_total::hist_result_daily_total( data_source_t, pump_model_t, large_pump_traits );
+		template hist_result_daily_total::hist_result_daily_total( data_source_t, pump_model_t, low_suspend_pump_traits );
+		template hist_change_sensor_setup::hist_change_sensor_setup( data_source_t, pump_model_t, small_pump_traits );
+		template hist_change_sensor_setup::hist_change_sensor_setup( data_source_t, pump_model_t, large_pump_traits );
+		template hist_change_sensor_setup::hist_change_sensor_setup( data_source_t, pump_model_t, low_suspend_pump_traits );
+		template hist_change_bolus_wizard_setup::hist_change_bolus_wizard_setup( data_source_t, pump_model_t, small_pump_traits );
+		template hist_change_bolus_wizard_setup::hist_change_bolus_wizard_setup( data_source_t, pump_model_t, large_pump_traits );
+		template hist_change_bolus_wizard_setup::hist_change_bolus_wizard_setup( data_source_t, pump_model_t, low_suspend_pump_traits );
+		template hist_bolus_wizard_estimate::hist_bolus_wizard_estimate( data_source_t, pump_model_t, small_pump_traits );
+		template hist_bolus_wizard_estimate::hist_bolus_wizard_estimate( data_source_t, pump_model_t, large_pump_traits );
+		template hist_bolus_wizard_estimate::hist_bolus_wizard_estimate( data_source_t, pump_model_t, low_suspend_pump_traits );
+
+		hist_overlay_entry::hist_overlay_entry( data_source_t data, pump_model_t pump_model, record_layout_t layout ):
+				history_entry_obj{ std::move( data ), false, layout.size, std::move( pump_model ), layout.timestamp_offset, layout.timestamp_size } { }
+
+		hist_overlay_entry::~hist_overlay_entry( ) { }
+
 		namespace {
-			template<typename... Args>
-			std::unique_ptr<history_entry_obj> create_history_entry_impl( uint8_t op_code, Args&&... arg ) {
-				return  std::unique_ptr<history_entry_obj>( [op_code]( Args&&... args ) -> history_entry_obj* {
-					switch( op_code ) {
-							case 0x00: return new hist_skip( std::forward<Args>( args )... );
-							case 0x01: return new hist_bolus_normal( std::forward<Args>( args )... );
-							case 0x03: return new hist_prime( std::forward<Args>( args )... );
-							case 0x06: return new hist_alarm_pump( std::forward<Args>( args )... );
-							case 0x07: return new hist_result_daily_total( std::forward<Args>( args )... );
-							case 0x08: return new hist_change_basal_profile_pattern( std::forward<Args>( args )... );
-							case 0x09: return new hist_change_basal_profile( std::forward<Args>( args )... );
-							case 0x0A: return new hist_cal_bg_for_ph( std::forward<Args>( args )... );
-							case 0x0B: return new hist_alarm_sensor( std::forward<Args>( args )... ); 
-							case 0x0C: return new hist_clear_alarm( std::forward<Args>( args )... );
-							case 0x14: return new hist_select_basal_profile( std::forward<Args>( args )... );
-							case 0x16: return new hist_temp_basal_duration( std::forward<Args>( args )... );
-							case 0x17: return new hist_change_time( std::forward<Args>( args )... );
-							case 0x19: return new hist_pump_low_battery( std::forward<Args>( args )... );
-							case 0x1A: return new hist_battery( std::forward<Args>( args )... );
-							case 0x1E: return new hist_suspend( std::forward<Args>( args )... );
-							case 0x1F: return new hist_resume( std::forward<Args>( args )... );
-							case 0x21: return new hist_rewind( std::forward<Args>( args )... );
-							case 0x23: return new hist_change_child_block_enable( std::forward<Args>( args )... );
-							case 0x24: return new hist_change_max_bolus( std::forward<Args>( args )... );
-							case 0x26: return new hist_enable_disable_remote( std::forward<Args>( args )... );
-							case 0x2C: return new hist_change_max_basal( std::forward<Args>( args )... );
-							case 0x31: return new hist_change_bg_reminder_offset( std::forward<Args>( args )... );
-							case 0x32: return new hist_change_alarm_clock_time( std::forward<Args>( args )... );
-							case 0x33: return new hist_temp_basal( std::forward<Args>( args )... );
-							case 0x34: return new hist_pump_low_reservoir( std::forward<Args>( args )... );
-							case 0x35: return new hist_alarm_clock_reminder( std::forward<Args>( args )... );
-							case 0x3B: return new hist_questionable_3b( std::forward<Args>( args )... );
-							case 0x3C: return new hist_change_paradigm_linkid( std::forward<Args>( args )... );
-							case 0x3F: return new hist_bg_received( std::forward<Args>( args )... );
-							case 0x40: return new hist_meal_marker( std::forward<Args>( args )... );
-							case 0x41: return new hist_exercise_marker( std::forward<Args>( args )... );
-							case 0x42: return new hist_manual_insulin_marker( std::forward<Args>( args )... );
-							case 0x43: return new hist_other_marker( std::forward<Args>( args )... );
-							case 0x50: return new hist_change_sensor_setup( std::forward<Args>( args )... );
-							case 0x56: return new hist_change_sensor_rate_of_change_alert_setup( std::forward<Args>( args )... );
-							case 0x57: return new hist_change_bolus_scroll_step_size( std::forward<Args>( args )... );
-							case 0x5A: return new hist_change_bolus_wizard_setup( std::forward<Args>( args )... );
-							case 0x5B: return new hist_bolus_wizard_estimate( std::forward<Args>( args )... );
-							case 0x5C: return new hist_unabsorbed_insulin( std::forward<Args>( args )... );
-							case 0x5E: return new hist_change_variable_bolus( std::forward<Args>( args )... );
-							case 0x5F: return new hist_change_audio_bolus( std::forward<Args>( args )... );
-							case 0x60: return new hist_change_bg_reminder_enable( std::forward<Args>( args )... );
-							case 0x61: return new hist_change_alarm_clock_enable( std::forward<Args>( args )... );
-							case 0x62: return new hist_change_temp_basal_type( std::forward<Args>( args )... );
-							case 0x63: return new hist_change_alarm_notify_mode( std::forward<Args>( args )... );
-							case 0x64: return new hist_change_time_format( std::forward<Args>( args )... );
-							case 0x65: return new hist_change_reservoir_warning_time( std::forward<Args>( args )... );
-							case 0x66: return new hist_change_bolus_reminder_enable( std::forward<Args>( args )... );
-							case 0x67: return new hist_change_bolus_reminder_time( std::forward<Args>( args )... );
-							case 0x68: return new hist_delete_bolus_reminder_time( std::forward<Args>( args )... );
-							case 0x6A: return new hist_delete_alarm_clock_time( std::forward<Args>( args )... );
-							case 0x6D: return new hist_model_522_result_totals( std::forward<Args>( args )... );
-							case 0x6E: return new hist_sara_6e( std::forward<Args>( args )... );
-							case 0x6F: return new hist_change_carb_units( std::forward<Args>( args )... );
-							case 0x7B: return new hist_basal_profile_start( std::forward<Args>( args )... );
-							case 0x7C: return new hist_change_watch_dog_enable( std::forward<Args>( args )... );
-							case 0x7D: return new hist_change_other_device_id( std::forward<Args>( args )... );
-							case 0x81: return new hist_change_watch_dog_marriage_profile( std::forward<Args>( args )... );
-							case 0x82: return new hist_delete_other_device_id( std::forward<Args>( args )... );
-							case 0x83: return new hist_change_capture_event_enable( std::forward<Args>( args )... );
-							default: return nullptr;
+			std::array<record_layout_t, 256> & opcode_overlays( ) {
+				static std::array<record_layout_t, 256> result{ };
+				return result;
+			}
+
+			uint64_t & opcode_overlays_hash( ) {
+				static uint64_t result = 0;
+				return result;
+			}
+
+			// FNV-1a over the overlays set, so no overlays hash to 0
+			void update_opcode_overlays_hash( ) {
+				uint64_t result = 0;
+				auto const & overlays = opcode_overlays( );
+				for( size_t op_code = 0; op_code < overlays.size( ); ++op_code ) {
+					auto const & layout = overlays[op_code];
+					if( layout.size == 0 ) {
+						continue;
+					}
+					if( result == 0 ) {
+						result = 0xCBF29CE484222325ull;
 					}
-				}( std::forward<Args>(arg)... ) );
+					for( auto value : { op_code, layout.size, layout.timestamp_offset, layout.timestamp_size } ) {
+						result = (result ^ static_cast<uint64_t>(value)) * 0x100000001B3ull;
+					}
+				}
+				opcode_overlays_hash( ) = result;
 			}
 		}	// namespace anonymous
 
-		std::unique_ptr<history_entry_obj> create_history_entry( data_source_t & data, pump_model_t pump_model, size_t & position ) {
-			auto result = create_history_entry_impl( data[0], data, std::move( pump_model ) );
+		void set_opcode_overlay( uint8_t op_code, record_layout_t layout ) {
+			assert( layout.size > 0 );
+			opcode_overlays( )[op_code] = layout;
+			update_opcode_overlays_hash( );
+		}
+
+		void clear_opcode_overlays( ) {
+			opcode_overlays( ).fill( record_layout_t{ 0, 0, 0 } );
+			opcode_overlays_hash( ) = 0;
+		}
+
+		uint64_t opcode_overlay_hash( ) {
+			return opcode_overlays_hash( );
+		}
+
+		boost::optional<record_layout_t> get_opcode_overlay( uint8_t op_code ) {
+			auto const & result = opcode_overlays( )[op_code];
+			if( result.size == 0 ) {
+				return boost::optional<record_layout_t>{ };
+			}
+			return result;
+		}
+
+		namespace {
+			// Entries whose layout depends on the pump family take the traits as a constructor argument
+			template<typename Entry, typename Traits>
+			history_entry_obj * construct_history_entry( data_source_t data, pump_model_t const & pump_model, Traits traits, std::true_type ) {
+				return new Entry( std::move( data ), pump_model, traits );
+			}
+
+			template<typename Entry, typename Traits>
+			history_entry_obj * construct_history_entry( data_source_t data, pump_model_t const & pump_model, Traits, std::false_type ) {
+				return new Entry( std::move( data ), pump_model );
+			}
+
+			// Constructors read their fields at fixed offsets, so the layout is checked against the
+			// data before one is run
+			template<typename Traits>
+			std::unique_ptr<history_entry_obj> create_history_entry_impl( data_source_t data, pump_model_t const & pump_model ) {
+				if( data.empty( ) ) {
+					return nullptr;
+				}
+				std::unique_ptr<history_entry_obj> result( visit_history_entry_type( data[0], [&]( auto entry_type ) -> history_entry_obj * {
+					using entry_t = typename decltype( entry_type )::type;
+					if( data.size( ) < entry_t::template layout<Traits>( data ).size ) {
+						return nullptr;
+					}
+					using has_traits_t = typename std::is_constructible<entry_t, data_source_t, pump_model_t, Traits>::type;
+					return construct_history_entry<entry_t>( data, pump_model, Traits{ }, has_traits_t{ } );
+				}, static_cast<history_entry_obj *>( nullptr ) ) );
+				if( !result ) {
+					auto const overlay = get_opcode_overlay( data[0] );
+					if( overlay && data.size( ) >= overlay->size ) {
+						result.reset( new hist_overlay_entry( data, pump_model, *overlay ) );
+					}
+				}
+				return result;
+			}
+		}	// namespace anonymous
+
+		template<typename Traits>
+		std::unique_ptr<history_entry_obj> create_history_entry( data_source_t & data, pump_model_t const & pump_model, size_t & position ) {
+			auto result = create_history_entry_impl<Traits>( data, pump_model );
 			if( !result || data.size( ) < result->size( ) ) {
 				return nullptr;
 			}
@@ -587,6 +778,70 @@ namespace daw {
 			data.advance( static_cast<data_source_t::difference_type>(result->size( )) );
 			return result;
 		}
+
+		template<typename Traits>
+		boost::optional<record_layout_t> frame_history_entry( data_source_t const & data ) {
+			if( data.empty( ) ) {
+				return boost::optional<record_layout_t>{ };
+			}
+			auto result = visit_history_entry_type( data[0], [&data]( auto entry_type ) -> boost::optional<record_layout_t> {
+				using entry_t = typename decltype( entry_type )::type;
+				return entry_t::template layout<Traits>( data );
+			}, boost::optional<record_layout_t>{ } );
+			if( !result ) {
+				result = get_opcode_overlay( data[0] );
+			}
+			if( !result || data.size( ) < result->size ) {
+				return boost::optional<record_layout_t>{ };
+			}
+			return result;
+		}
+
+		template boost::optional<record_layout_t> frame_history_entry<small_pump_traits>( data_source_t const & );
+		template boost::optional<record_layout_t> frame_history_entry<large_pump_traits>( data_source_t const & );
+		template boost::optional<record_layout_t> frame_history_entry<low_suspend_pump_traits>( data_source_t const & );
+
+		bool has_valid_timestamp( data_source_t const & data, record_layout_t const & layout ) {
+			auto const ts = data.slice( layout.timestamp_offset );
+			switch( layout.timestamp_size ) {
+			case 2: {
+					uint8_t const day = ts[0] & 0b00011111;
+					uint8_t const month = ((ts[0] & 0b11100000) >> 4) + ((ts[1] & 0b10000000) >> 7);
+					return day >= 1 && day <= 31 && month >= 1 && month <= 12;
+				}
+			case 5: {
+					uint8_t const second = ts[0] & 0b00111111;
+					uint8_t const minute = ts[1] & 0b00111111;
+					uint8_t const hour = ts[2] & 0b00011111;
+					uint8_t const day = ts[3] & 0b00011111;
+					uint8_t const month = ((ts[0] >> 4) & 0b00001100) + (ts[1] >> 6);
+					return day >= 1 && day <= 31 && month >= 1 && month <= 12 && hour < 24 && minute < 60 && second < 60;
+				}
+			default:
+				return false;
+			}
+		}
+
+		boost::optional<boost::posix_time::ptime> parse_history_timestamp( data_source_t const & data, record_layout_t const & layout, timezone_table const * zone ) {
+			return parse_timestamp_in_array( data, layout.timestamp_offset, layout.timestamp_size, zone );
+		}
+
+		template std::unique_ptr<history_entry_obj> create_history_entry<small_pump_traits>( data_source_t &, pump_model_t const &, size_t & );
+		template std::unique_ptr<history_entry_obj> create_history_entry<large_pump_traits>( data_source_t &, pump_model_t const &, size_t & );
+		template std::unique_ptr<history_entry_obj> create_history_entry<low_suspend_pump_traits>( data_source_t &, pump_model_t const &, size_t & );
+
+		history_decoder_t get_history_decoder( pump_model_t const & pump_model ) {
+			switch( pump_model.family( ) ) {
+				case pump_family_t::small: return &create_history_entry<small_pump_traits>;
+				case pump_family_t::large: return &create_history_entry<large_pump_traits>;
+				case pump_family_t::low_suspend: return &create_history_entry<low_suspend_pump_traits>;
+			}
+			return nullptr;
+		}
+
+		std::unique_ptr<history_entry_obj> create_history_entry( data_source_t & data, pump_model_t pump_model, size_t & position ) {
+			return get_history_decoder( pump_model )( data, pump_model, position );
+		}
 	}	// namespace history
 }	// namespace daw
 
@@ -0,0 +1,142 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "history_range.h"
+#include "trace.h"
+
+namespace daw {
+	namespace history {
+		history_record_view::history_record_view( history_range const * range, history_frame_t frame ):
+			m_range{ range },
+			m_frame( std::move( frame ) ) { }
+
+		bool history_record_view::is_error( ) const {
+			return m_frame.kind == history_frame_kind_t::error;
+		}
+
+		uint8_t history_record_view::op_code( ) const {
+			return m_range->m_page[m_frame.offset];
+		}
+
+		size_t history_record_view::offset( ) const {
+			return m_frame.offset;
+		}
+
+		size_t history_record_view::size( ) const {
+			return m_frame.size;
+		}
+
+		record_layout_t history_record_view::layout( ) const {
+			return m_frame.layout;
+		}
+
+		data_source_t history_record_view::data( ) const {
+			return m_range->m_page.slice( m_frame.offset, m_frame.offset + m_frame.size );
+		}
+
+		boost::optional<boost::posix_time::ptime> history_record_view::timestamp( ) const {
+			if( is_error( ) ) {
+				return boost::optional<boost::posix_time::ptime>{ };
+			}
+			return parse_history_timestamp( data( ), m_frame.layout, m_range->m_pump_model.timezone.get( ) );
+		}
+
+		std::unique_ptr<history_entry_obj> history_record_view::decode( ) const {
+			if( is_error( ) ) {
+				return nullptr;
+			}
+			daw::trace::scoped_span const span{ "create_history_entry", "decode", "op_code", op_code( ) };
+			auto entry_data = data( );
+			auto position = m_frame.offset;
+			return m_range->m_decoder( entry_data, m_range->m_pump_model, position );
+		}
+
+		history_range::iterator::iterator( history_range const * range, size_t offset ):
+			m_range{ range },
+			m_offset{ offset },
+			m_frame{ history_frame_kind_t::padding, offset, 0, record_layout_t{ 0, 0, 0 } } {
+
+			skip_padding( );
+		}
+
+		void history_range::iterator::skip_padding( ) {
+			auto const & page = m_range->m_page;
+			while( m_offset < page.size( ) ) {
+				m_frame = m_range->m_framer.next( page, m_offset );
+				if( m_frame.kind != history_frame_kind_t::padding ) {
+					return;
+				}
+				m_offset += m_frame.size;
+			}
+		}
+
+		history_record_view history_range::iterator::operator*( ) const {
+			return history_record_view{ m_range, m_frame };
+		}
+
+		history_range::iterator & history_range::iterator::operator++( ) {
+			m_offset += m_frame.size;
+			skip_padding( );
+			return *this;
+		}
+
+		history_range::iterator history_range::iterator::operator++( int ) {
+			auto result = *this;
+			++(*this);
+			return result;
+		}
+
+		bool operator==( history_range::iterator const & lhs, history_range::iterator const & rhs ) {
+			return lhs.m_range == rhs.m_range && lhs.m_offset == rhs.m_offset;
+		}
+
+		bool operator!=( history_range::iterator const & lhs, history_range::iterator const & rhs ) {
+			return !(lhs == rhs);
+		}
+
+		history_range::history_range( data_source_t page, pump_model_t pump_model, framing_options_t options ):
+			m_page{ std::move( page ) },
+			m_pump_model{ std::move( pump_model ) },
+			m_framer{ m_pump_model, std::move( options ) },
+			m_decoder{ get_history_decoder( m_pump_model ) } { }
+
+		history_range::iterator history_range::begin( ) const {
+			return iterator{ this, 0 };
+		}
+
+		history_range::iterator history_range::end( ) const {
+			return iterator{ this, m_page.size( ) };
+		}
+
+		data_source_t const & history_range::page( ) const {
+			return m_page;
+		}
+
+		pump_model_t const & history_range::pump_model( ) const {
+			return m_pump_model;
+		}
+
+		history_range decode( data_source_t page, pump_model_t pump_model, framing_options_t options ) {
+			return history_range{ std::move( page ), std::move( pump_model ), std::move( options ) };
+		}
+	}	// namespace history
+}	// namespace daw
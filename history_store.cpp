@@ -0,0 +1,418 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include "history_store.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			constexpr uint64_t const store_magic = 0x31534853444D4D00ull;	// "\0MMDSHS1"
+			constexpr uint32_t const store_version = 1;
+			constexpr std::streamoff const header_size = sizeof( store_header_t );
+
+			static_assert( sizeof( store_header_t ) == 64, "store_header_t is part of the file format" );
+			static_assert( sizeof( store_record_t ) == 24, "store_record_t is part of the file format" );
+			static_assert( sizeof( store_block_t ) == 56, "store_block_t is part of the file format" );
+
+			uint64_t file_size( std::string const & name ) {
+				std::ifstream ifs( name.c_str( ), std::ios::binary | std::ios::ate );
+				if( !ifs ) {
+					return 0;
+				}
+				return static_cast<uint64_t>(ifs.tellg( ));
+			}
+
+			std::fstream open_file( std::string const & name, bool truncate ) {
+				if( truncate ) {
+					std::ofstream create( name.c_str( ), std::ios::binary | std::ios::trunc );
+				}
+				std::fstream result( name.c_str( ), std::ios::binary | std::ios::in | std::ios::out );
+				if( !result ) {
+					throw std::runtime_error( "Could not open history store file " + name );
+				}
+				return result;
+			}
+
+			template<typename T>
+			void write_pod( std::fstream & fs, T const & value ) {
+				fs.write( reinterpret_cast<char const *>(&value), sizeof( T ) );
+			}
+
+			template<typename T>
+			T read_pod( std::fstream & fs ) {
+				T result;
+				fs.read( reinterpret_cast<char *>(&result), sizeof( T ) );
+				return result;
+			}
+
+			store_block_t empty_block( uint64_t first_record ) {
+				return store_block_t{ std::numeric_limits<int64_t>::max( ), std::numeric_limits<int64_t>::min( ), first_record, { 0, 0, 0, 0 } };
+			}
+
+			void add_to_block( store_block_t & block, store_record_t const & record ) {
+				block.min_timestamp = std::min( block.min_timestamp, record.timestamp );
+				block.max_timestamp = std::max( block.max_timestamp, record.timestamp );
+				block.op_codes[record.op_code / 64] |= 1ull << (record.op_code % 64);
+			}
+
+			// Records without a timestamp carried from an empty store keep no_timestamp
+			history_key_t make_key( uint8_t const * data, size_t size, int64_t timestamp ) {
+				auto ts = timestamp == no_timestamp ? boost::posix_time::ptime{ boost::posix_time::neg_infin } : boost::posix_time::from_time_t( static_cast<std::time_t>(timestamp) );
+				return history_key_t{ data[0], std::move( ts ), hash_history_data( data, size ) };
+			}
+		}	// namespace anonymous
+
+		history_store_writer::history_store_writer( std::string path, uint32_t records_per_block ):
+			m_path{ std::move( path ) },
+			m_records{ },
+			m_raw{ },
+			m_index{ },
+			m_count{ 0 },
+			m_committed{ 0 },
+			m_raw_size{ 0 },
+			m_records_per_block{ records_per_block },
+			m_block( empty_block( 0 ) ),
+			m_last_timestamp{ std::numeric_limits<int64_t>::min( ) },
+			m_positioned{ false } {
+
+			assert( records_per_block > 0 );
+			if( file_size( m_path ) < sizeof( store_header_t ) ) {
+				create_new( );
+			} else {
+				open_existing( );
+			}
+		}
+
+		history_store_writer::~history_store_writer( ) {
+			flush( );
+		}
+
+		void history_store_writer::create_new( ) {
+			m_records = open_file( m_path, true );
+			m_raw = open_file( m_path + ".raw", true );
+			m_index = open_file( m_path + ".idx", true );
+			store_header_t header{ store_magic, store_version, m_records_per_block, 0, { 0, 0, 0, 0, 0 } };
+			write_pod( m_records, header );
+			m_records.flush( );
+		}
+
+		void history_store_writer::open_existing( ) {
+			m_records = open_file( m_path, false );
+			m_raw = open_file( m_path + ".raw", false );
+			m_index = open_file( m_path + ".idx", false );
+			auto const header = read_pod<store_header_t>( m_records );
+			if( header.magic != store_magic || header.version != store_version || header.records_per_block == 0 ) {
+				throw std::runtime_error( "Not a history store " + m_path );
+			}
+			m_records_per_block = header.records_per_block;
+			m_count = header.record_count;
+			m_committed = m_count;
+
+			// Anything past the committed count is from an interrupted append and is overwritten
+			auto const block_start = (m_count / m_records_per_block) * m_records_per_block;
+			m_block = empty_block( block_start );
+			m_records.seekg( header_size + static_cast<std::streamoff>(block_start * sizeof( store_record_t )) );
+			for( auto n = block_start; n < m_count; ++n ) {
+				auto const record = read_pod<store_record_t>( m_records );
+				add_to_block( m_block, record );
+				m_raw_size = record.data_offset + record.size;
+				m_last_timestamp = record.timestamp;
+			}
+			if( m_count > 0 && block_start == m_count ) {
+				m_records.seekg( header_size + static_cast<std::streamoff>((m_count - 1) * sizeof( store_record_t )) );
+				auto const record = read_pod<store_record_t>( m_records );
+				m_raw_size = record.data_offset + record.size;
+				m_last_timestamp = record.timestamp;
+			}
+		}
+
+		void history_store_writer::seek_end( ) {
+			if( m_positioned ) {
+				return;
+			}
+			m_records.seekp( header_size + static_cast<std::streamoff>(m_count * sizeof( store_record_t )) );
+			m_raw.seekp( static_cast<std::streamoff>(m_raw_size) );
+			m_index.seekp( static_cast<std::streamoff>((m_count / m_records_per_block) * sizeof( store_block_t )) );
+			m_positioned = true;
+		}
+
+		void history_store_writer::add_record( int64_t timestamp, bool has_timestamp, uint8_t const * data, size_t size ) {
+			store_record_t const record{ timestamp, m_raw_size, static_cast<uint16_t>(size), data[0], static_cast<uint8_t>(has_timestamp ? 1 : 0), { 0, 0, 0, 0 } };
+			write_pod( m_records, record );
+			m_raw.write( reinterpret_cast<char const *>(data), static_cast<std::streamsize>(size) );
+			m_raw_size += size;
+			m_last_timestamp = timestamp;
+			add_to_block( m_block, record );
+			++m_count;
+			if( m_count % m_records_per_block == 0 ) {
+				write_pod( m_index, m_block );
+				m_block = empty_block( m_count );
+			}
+		}
+
+		void history_store_writer::commit( ) {
+			m_raw.flush( );
+			m_index.flush( );
+			m_records.flush( );
+			m_records.seekp( static_cast<std::streamoff>(offsetof( store_header_t, record_count )) );
+			write_pod( m_records, m_count );
+			m_records.flush( );
+			m_committed = m_count;
+			m_positioned = false;
+		}
+
+		void history_store_writer::flush( ) {
+			if( m_count != m_committed && m_records.is_open( ) ) {
+				commit( );
+			}
+		}
+
+		std::unordered_set<history_key_t, history_key_hash_t> history_store_writer::stored_keys( int64_t first_timestamp ) {
+			std::unordered_set<history_key_t, history_key_hash_t> result;
+			if( m_count == 0 || first_timestamp > m_last_timestamp ) {
+				return result;
+			}
+			// Reading moves the files off the end, entries not yet committed are still buffered
+			m_records.flush( );
+			m_raw.flush( );
+			m_positioned = false;
+			auto const read_record = [this]( uint64_t index ) {
+				m_records.seekg( header_size + static_cast<std::streamoff>(index * sizeof( store_record_t )) );
+				return read_pod<store_record_t>( m_records );
+			};
+			uint64_t first = 0;
+			uint64_t last = m_count;
+			while( first < last ) {
+				auto const middle = first + (last - first) / 2;
+				if( read_record( middle ).timestamp < first_timestamp ) {
+					first = middle + 1;
+				} else {
+					last = middle;
+				}
+			}
+			if( first == m_count ) {
+				return result;
+			}
+			auto record = read_record( first );
+			// The raw bytes of consecutive records are contiguous
+			m_raw.seekg( static_cast<std::streamoff>(record.data_offset) );
+			std::vector<uint8_t> data;
+			for( auto n = first; n < m_count; ++n ) {
+				if( n != first ) {
+					record = read_pod<store_record_t>( m_records );
+				}
+				data.resize( record.size );
+				m_raw.read( reinterpret_cast<char *>(data.data( )), static_cast<std::streamsize>(record.size) );
+				result.insert( make_key( data.data( ), data.size( ), record.timestamp ) );
+			}
+			if( !m_records || !m_raw ) {
+				throw std::runtime_error( "Could not read history store " + m_path );
+			}
+			return result;
+		}
+
+		history_store_append_t history_store_writer::append( history_record_table_t const & records ) {
+			history_store_append_t result{ 0, 0, 0, { } };
+			if( records.size( ) == 0 ) {
+				return result;
+			}
+			// Records without a timestamp keep the position of the record before them on the same
+			// page, or of the first timestamped record when they lead it.  Downloads are newest page
+			// first so the record before a page is not older than it
+			auto const page_of = [&records]( size_t n ) -> uint32_t {
+				return records.pages.empty( ) ? 0 : records.pages[n];
+			};
+			std::vector<int64_t> timestamps( records.size( ) );
+			for( size_t first = 0; first < records.size( ); ) {
+				auto last = first;
+				auto carried = m_last_timestamp;
+				bool found = false;
+				for( ; last < records.size( ) && page_of( last ) == page_of( first ); ++last ) {
+					if( !found && records.timestamps[last] != no_timestamp ) {
+						carried = records.timestamps[last];
+						found = true;
+					}
+				}
+				for( auto n = first; n < last; ++n ) {
+					if( records.timestamps[n] != no_timestamp ) {
+						carried = records.timestamps[n];
+					}
+					timestamps[n] = carried;
+				}
+				first = last;
+			}
+			std::vector<size_t> order( records.size( ) );
+			std::iota( order.begin( ), order.end( ), 0 );
+			std::stable_sort( order.begin( ), order.end( ), [&timestamps]( size_t lhs, size_t rhs ) {
+				return timestamps[lhs] < timestamps[rhs];
+			} );
+
+			// A download overlaps the last one so only the stored tail it covers is looked at
+			auto keys = stored_keys( timestamps[order.front( )] );
+			seek_end( );
+			for( auto n : order ) {
+				auto const data = records.data.data( ) + records.data_offsets[n];
+				if( !keys.insert( make_key( data, records.sizes[n], timestamps[n] ) ).second ) {
+					++result.duplicates;
+					continue;
+				}
+				if( timestamps[n] < m_last_timestamp ) {
+					++result.out_of_order;
+					continue;
+				}
+				add_record( timestamps[n], records.timestamps[n] != no_timestamp, data, records.sizes[n] );
+				result.records.push_back( n );
+			}
+			result.appended = result.records.size( );
+			commit( );
+			return result;
+		}
+
+		bool history_store_writer::append( history_entry_obj const & entry ) {
+			auto const has_timestamp = static_cast<bool>(entry.timestamp( ));
+			auto const timestamp = has_timestamp ? to_epoch_seconds( *entry.timestamp( ) ) : m_last_timestamp;
+			if( timestamp < m_last_timestamp || entry.data( ).empty( ) ) {
+				return false;
+			}
+			if( m_count > 0 && timestamp == m_last_timestamp ) {
+				auto const key = make_key( entry.data( ).data( ), entry.data( ).size( ), timestamp );
+				if( stored_keys( timestamp ).count( key ) != 0 ) {
+					return false;
+				}
+			}
+			seek_end( );
+			add_record( timestamp, has_timestamp, entry.data( ).data( ), entry.data( ).size( ) );
+			if( m_count % m_records_per_block == 0 ) {
+				commit( );
+			}
+			return true;
+		}
+
+		size_t history_store_writer::size( ) const {
+			return static_cast<size_t>(m_count);
+		}
+
+		history_store_reader::history_store_reader( std::string path ):
+			m_path{ std::move( path ) },
+			m_records{ },
+			m_raw{ },
+			m_index{ },
+			m_count{ 0 },
+			m_records_per_block{ 1 } {
+
+			refresh( );
+		}
+
+		history_store_reader::~history_store_reader( ) { }
+
+		void history_store_reader::refresh( ) {
+			auto const map_file = []( boost::iostreams::mapped_file_source & file, std::string const & name ) {
+				if( file.is_open( ) ) {
+					file.close( );
+				}
+				if( file_size( name ) > 0 ) {
+					file.open( name );
+				}
+			};
+			m_count = 0;
+			map_file( m_records, m_path );
+			if( !m_records.is_open( ) || m_records.size( ) < sizeof( store_header_t ) ) {
+				return;
+			}
+			store_header_t header;
+			std::memcpy( &header, m_records.data( ), sizeof( header ) );
+			// pairs with the writer flushing records before the count
+			std::atomic_thread_fence( std::memory_order_acquire );
+			if( header.magic != store_magic || header.version != store_version || header.records_per_block == 0 ) {
+				throw std::runtime_error( "Not a history store " + m_path );
+			}
+			m_records_per_block = header.records_per_block;
+			auto const mapped_records = (m_records.size( ) - sizeof( store_header_t )) / sizeof( store_record_t );
+			m_count = std::min<uint64_t>( header.record_count, mapped_records );
+
+			// raw bytes and index entries are written before the count, so mapping them after
+			// reading it covers every committed record
+			map_file( m_raw, m_path + ".raw" );
+			map_file( m_index, m_path + ".idx" );
+		}
+
+		size_t history_store_reader::size( ) const {
+			return static_cast<size_t>(m_count);
+		}
+
+		store_record_t const * history_store_reader::records( ) const {
+			return reinterpret_cast<store_record_t const *>(m_records.data( ) + sizeof( store_header_t ));
+		}
+
+		store_block_t const * history_store_reader::blocks( ) const {
+			return reinterpret_cast<store_block_t const *>(m_index.data( ));
+		}
+
+		size_t history_store_reader::block_count( ) const {
+			auto const indexed = m_index.is_open( ) ? m_index.size( ) / sizeof( store_block_t ) : 0;
+			return std::min<size_t>( indexed, static_cast<size_t>(m_count / m_records_per_block) );
+		}
+
+		void history_store_reader::scan( size_t first, size_t last, uint8_t op_code, int64_t first_timestamp, int64_t last_timestamp, std::vector<history_store_record_t> & result ) const {
+			auto const recs = records( );
+			auto it = std::lower_bound( recs + first, recs + last, first_timestamp, []( store_record_t const & record, int64_t ts ) {
+				return record.timestamp < ts;
+			} );
+			auto const raw = reinterpret_cast<uint8_t const *>(m_raw.data( ));
+			for( ; it != recs + last && it->timestamp <= last_timestamp; ++it ) {
+				if( it->op_code == op_code ) {
+					result.push_back( history_store_record_t{ it->timestamp, it->has_timestamp != 0, it->op_code, raw + it->data_offset, it->size } );
+				}
+			}
+		}
+
+		std::vector<history_store_record_t> history_store_reader::find( uint8_t op_code, int64_t first_timestamp, int64_t last_timestamp ) const {
+			std::vector<history_store_record_t> result;
+			if( m_count == 0 ) {
+				return result;
+			}
+			auto const first_block = blocks( );
+			auto const last_block = first_block + block_count( );
+			auto block = std::partition_point( first_block, last_block, [first_timestamp]( store_block_t const & b ) {
+				return b.max_timestamp < first_timestamp;
+			} );
+			for( ; block != last_block && block->min_timestamp <= last_timestamp; ++block ) {
+				if( block->op_codes[op_code / 64] & (1ull << (op_code % 64)) ) {
+					scan( static_cast<size_t>(block->first_record), static_cast<size_t>(block->first_record + m_records_per_block), op_code, first_timestamp, last_timestamp, result );
+				}
+			}
+			if( block == last_block ) {
+				// the last, partial, block is not indexed yet
+				scan( block_count( ) * m_records_per_block, static_cast<size_t>(m_count), op_code, first_timestamp, last_timestamp, result );
+			}
+			return result;
+		}
+	}	// namespace history
+}	// namespace daw
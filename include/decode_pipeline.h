@@ -0,0 +1,66 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "history_decode.h"
+#include "memory_budget.h"
+
+namespace daw {
+	namespace history {
+		struct pipeline_stage_stats_t {
+			std::string name;
+			std::chrono::nanoseconds busy;	// time spent working, not waiting on a queue
+			std::chrono::nanoseconds wall;
+			size_t batches;
+
+			double utilisation( ) const;
+		};	// pipeline_stage_stats_t
+
+		class page_cache;
+
+		struct pipeline_options_t {
+			// pages in flight between each pair of stages
+			size_t queue_capacity;
+			framing_options_t framing;
+			// When set, ingest waits while pages, decoded records and unwritten output are
+			// over the budget's limit
+			memory_budget * budget;
+			// When set, pages already framed are taken from the cache
+			page_cache * cache;
+
+			pipeline_options_t( );
+		};	// pipeline_options_t
+
+		// Decodes the hex dump on input to output with ingest, framing, decoding, encoding and
+		// writing each on their own thread.  Stages pass one page at a time through bounded
+		// spsc_queues, so a slow stage holds back the ones before it.  The output matches the
+		// serial decoder page by page
+		std::vector<pipeline_stage_stats_t> run_decode_pipeline( std::istream & input, std::ostream & output, pump_model_t const & pump_model, pipeline_options_t const & options = pipeline_options_t{ } );
+	}	// namespace history
+}	// namespace daw
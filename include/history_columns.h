@@ -0,0 +1,51 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		// The decoded numeric fields of every record with one op_code.  Row n of each column is
+		// the same record, in download order
+		struct history_columns_t {
+			uint8_t op_code;
+			std::vector<int64_t> timestamps;	// seconds since the epoch in UTC or no_timestamp
+			std::vector<std::string> names;
+			std::vector<std::vector<double>> values;	// values[n] is the column names[n]
+
+			explicit history_columns_t( uint8_t code );
+			size_t size( ) const;
+		};	// history_columns_t
+
+		// Empty for op_codes without decoded numeric fields
+		std::vector<std::string> history_column_names( uint8_t op_code );
+
+		// A table for each op_code in download, in op_code order.  Op_codes without decoded
+		// numeric fields only have timestamps
+		std::vector<history_columns_t> decode_history_columns( history_download_t const & download, pump_model_t const & pump_model );
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,135 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "history_pages_base.h"
+
+namespace daw {
+	namespace history {
+		// A history page is 1022 bytes of entries followed by a big endian CRC16-CCITT
+		constexpr size_t const history_page_size = 1024;
+		constexpr int64_t const no_timestamp = std::numeric_limits<int64_t>::min( );
+
+		uint16_t crc16_ccitt( uint8_t const * first, uint8_t const * last ) noexcept;
+
+		// page includes the two trailing CRC bytes
+		bool check_page_crc( data_source_t const & page ) noexcept;
+
+		int64_t to_epoch_seconds( boost::posix_time::ptime const & ts );
+
+		enum class history_frame_kind_t: uint8_t {
+			record,
+			padding,
+			error
+		};
+
+		struct history_frame_t {
+			history_frame_kind_t kind;
+			size_t offset;
+			size_t size;
+			record_layout_t layout;
+		};	// history_frame_t
+
+		struct framing_options_t {
+			// After an unknown byte, framing only resumes on an entry timestamped within these years
+			uint16_t min_resync_year;
+			uint16_t max_resync_year;
+			// Longest unrecognised span, a longer one is split so each frame is bounded work
+			size_t max_error_span;
+
+			framing_options_t( );
+			framing_options_t( uint16_t min_year, uint16_t max_year, size_t max_error = history_page_size );
+		};	// framing_options_t
+
+		using history_framer_fn_t = boost::optional<record_layout_t>(*)( data_source_t const & data );
+
+		// Splits a buffer into entries, padding and unrecognised spans.  next( ) depends only on
+		// the buffer and offset, so any offset can be framed independently
+		class history_framer {
+			history_framer_fn_t m_frame;
+			framing_options_t m_options;
+			std::shared_ptr<timezone_table const> m_timezone;
+
+			bool is_resync_point( data_source_t const & data ) const;
+		public:
+			explicit history_framer( pump_model_t const & pump_model, framing_options_t options = framing_options_t{ } );
+			history_frame_t next( data_source_t const & buffer, size_t offset ) const;
+			boost::optional<record_layout_t> frame( data_source_t const & data ) const;
+			// The pump model's zone its timestamps are converted to UTC in
+			timezone_table const * timezone( ) const;
+		};	// history_framer
+
+		// Struct of arrays over every record in a download.  Record n's bytes are
+		// data[data_offsets[n]] to data[data_offsets[n] + sizes[n]]
+		struct history_record_table_t {
+			std::vector<uint8_t> op_codes;
+			std::vector<int64_t> timestamps;	// seconds since the epoch in UTC or no_timestamp
+			std::vector<uint32_t> pages;
+			std::vector<uint32_t> offsets;		// within the page
+			std::vector<uint32_t> sizes;
+			std::vector<uint32_t> data_offsets;
+			std::vector<uint8_t> data;
+
+			size_t size( ) const;
+			void reserve( size_t records, size_t bytes );
+		};	// history_record_table_t
+
+		struct history_error_span_t {
+			uint32_t page;
+			uint32_t offset;
+			uint32_t size;
+		};	// history_error_span_t
+
+		enum class page_status_t: uint8_t {
+			ok,
+			crc_mismatch,
+			too_short
+		};
+
+		struct history_page_status_t {
+			page_status_t status;
+			uint32_t records;
+			uint32_t error_bytes;
+		};	// history_page_status_t
+
+		struct history_download_t {
+			history_record_table_t records;
+			std::vector<history_error_span_t> errors;
+			std::vector<history_page_status_t> pages;
+		};	// history_download_t
+
+		// Decodes every page of a download in one call.  Each page includes its CRC.  Records
+		// are only framed and timestamped, no history_entry_obj is created
+		history_download_t decode_history_download( data_source_t const * first_page, data_source_t const * last_page, pump_model_t const & pump_model, framing_options_t const & options = framing_options_t{ } );
+
+		// Splits download into history_page_size pages when it is a whole number of them,
+		// otherwise treats it as one page
+		std::vector<data_source_t> split_history_pages( data_source_t download );
+
+		history_download_t decode_history_download( data_source_t download, pump_model_t const & pump_model, framing_options_t const & options = framing_options_t{ } );
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,94 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace daw {
+	namespace history {
+		enum class input_compression_t: uint8_t { none, gzip, zstd, bzip2 };
+
+		std::string to_string( input_compression_t compression );
+
+		// Looks at the magic bytes at the current position of a seekable stream without
+		// consuming them
+		input_compression_t detect_compression( std::istream & input );
+
+		// A history file, decompressed as it is read when it is a gzip, zstd or bzip2 archive.
+		// Archives made by concatenating several compressed files are read through to the end
+		class history_input_file {
+			std::ifstream m_file;
+			boost::iostreams::filtering_istream m_stream;
+			input_compression_t m_compression;
+		public:
+			explicit history_input_file( std::string const & file_name, size_t buffer_size = 64*1024 );
+			bool is_open( ) const;
+			input_compression_t compression( ) const;
+			std::istream & stream( );
+
+			history_input_file( history_input_file const & ) = delete;
+			history_input_file & operator=( history_input_file const & ) = delete;
+			~history_input_file( );
+		};	// history_input_file
+
+		// Pages are either a hex dump or the raw bytes read from the pump.  automatic decides
+		// from the first chunk read
+		enum class input_encoding_t: uint8_t { automatic, hex, binary };
+
+		// Incremental hex text to bytes.  Whitespace is skipped and a digit pair may be split
+		// between calls
+		class hex_decoder {
+			int m_high;
+		public:
+			hex_decoder( );
+			void feed( char const * first, char const * last, std::vector<uint8_t> & out );
+		};	// hex_decoder
+
+		// Reads one or more history pages in fixed size chunks and returns them a page at a
+		// time, without the CRC
+		class history_page_reader {
+			std::istream * m_input;
+			hex_decoder m_hex;
+			input_encoding_t m_encoding;
+			std::vector<char> m_buffer;
+			std::vector<uint8_t> m_pending;
+			size_t m_start;
+			bool m_eof;
+
+			size_t pending( ) const;
+
+			void fill( size_t bytes );
+		public:
+			explicit history_page_reader( std::istream & input, size_t buffer_size = 64*1024, input_encoding_t encoding = input_encoding_t::automatic );
+			bool next( std::vector<uint8_t> & page );
+			// The next page including its CRC
+			bool next_raw( std::vector<uint8_t> & page );
+			input_encoding_t encoding( ) const;
+		};	// history_page_reader
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,105 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include "history_pages_base.h"
+
+namespace daw {
+	namespace history {
+		// FNV-1a over the raw record bytes
+		uint64_t hash_history_data( uint8_t const * data, size_t size ) noexcept;
+		uint64_t hash_history_data( std::vector<uint8_t> const & data ) noexcept;
+
+		// Cheap identity of a record used to detect the same record in overlapping downloads
+		struct history_key_t {
+			uint8_t op_code;
+			boost::posix_time::ptime timestamp;
+			uint64_t data_hash;
+
+			history_key_t( history_entry_obj const & entry, boost::posix_time::ptime ts );
+			history_key_t( uint8_t op, boost::posix_time::ptime ts, uint64_t hash );
+		};	// history_key_t
+
+		bool operator==( history_key_t const & lhs, history_key_t const & rhs ) noexcept;
+
+		struct history_key_hash_t {
+			size_t operator( )( history_key_t const & key ) const noexcept;
+		};	// history_key_hash_t
+
+		// A decoded page stream. Returns nullptr when exhausted.  Each stream must be in
+		// non-decreasing timestamp order; records without a timestamp sort with the record
+		// before them.
+		using history_stream_t = std::function<std::unique_ptr<history_entry_obj>( )>;
+
+		// k-way merge of several decoded streams for one pump, dropping duplicate records.
+		// Only keys within window of the newest emitted timestamp are remembered, so memory
+		// is bounded by the overlap between streams and not the length of the history
+		class history_merge {
+			struct head_t {
+				std::unique_ptr<history_entry_obj> entry;
+				boost::posix_time::ptime timestamp;
+			};
+
+			std::vector<history_stream_t> m_streams;
+			std::vector<head_t> m_heads;
+			std::vector<size_t> m_heap;
+			boost::posix_time::time_duration m_window;
+			std::unordered_set<history_key_t, history_key_hash_t> m_seen;
+			std::deque<history_key_t> m_seen_order;
+			size_t m_duplicates;
+			bool m_started;
+
+			bool pull( size_t stream_index );
+			bool is_later( size_t lhs, size_t rhs ) const;
+			void start( );
+			void evict( boost::posix_time::ptime const & now );
+		public:
+			explicit history_merge( boost::posix_time::time_duration window = boost::posix_time::minutes( 0 ) );
+			void add_stream( history_stream_t stream );
+			std::unique_ptr<history_entry_obj> next( );
+			size_t duplicates( ) const;
+			size_t window_size( ) const;
+
+			~history_merge( );
+			history_merge( history_merge const & ) = delete;
+			history_merge( history_merge && ) = default;
+			history_merge & operator=( history_merge const & ) = delete;
+			history_merge & operator=( history_merge && ) = default;
+		};	// history_merge
+
+		// Adapts an already decoded list of entries to a history_stream_t
+		history_stream_t make_history_stream( std::vector<std::unique_ptr<history_entry_obj>> entries );
+
+		// Decodes a download into a stream for history_merge.  A pump sends its newest page first
+		// and each page is in time order, so the pages are put in order of their first timestamp.
+		// Pages are history_page_size - 2 bytes, without their CRC
+		history_stream_t make_download_stream( data_source_t download, pump_model_t const & pump_model );
+	}	// namespace history
+}	// namespace daw
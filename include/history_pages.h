@@ -47,7 +47,14 @@ namespace daw {
 			uint16_t m_duration;
 			bolus_type_t bolus_type;	 
 
-			hist_bolus_normal( data_source_t data, pump_model_t pump_model );
+			template<typename Traits>
+			hist_bolus_normal( data_source_t data, pump_model_t pump_model, Traits );
+
+			template<typename Traits>
+			static record_layout_t layout( data_source_t const & ) {
+				return record_layout_t{ Traits::larger ? 13u : 9u, Traits::larger ? 8u : 4u, 5 };
+			}
+
 			virtual ~hist_bolus_normal( );
 			hist_bolus_normal( hist_bolus_normal const & ) = default;
 			hist_bolus_normal( hist_bolus_normal && ) = default;
@@ -84,7 +91,13 @@ namespace daw {
 
 
 		struct hist_result_daily_total: public history_entry<0x07> {
-			hist_result_daily_total( data_source_t data, pump_model_t pump_model );
+			template<typename Traits>
+			hist_result_daily_total( data_source_t data, pump_model_t pump_model, Traits );
+
+			template<typename Traits>
+			static record_layout_t layout( data_source_t const & ) {
+				return record_layout_t{ Traits::larger ? 10u : 7u, 5, 2 };
+			}
 
 			virtual ~hist_result_daily_total( );
 			hist_result_daily_total( hist_result_daily_total const & ) = default;
@@ -93,8 +106,34 @@ namespace daw {
 			hist_result_daily_total & operator=( hist_result_daily_total && ) = default;
 		};	// hist_result_daily_total
 
-		using hist_change_basal_profile_pattern = history_entry_static<0x08, false, 152>;
-		using hist_change_basal_profile = history_entry_static<0x09, false, 152>;
+		struct basal_rate_t: public daw::json::JsonLink<basal_rate_t> {
+			uint16_t m_offset;	// minutes after midnight
+			double m_rate;	// U/h
+			virtual ~basal_rate_t( );
+			basal_rate_t( uint16_t offset = 0, double rate = 0.0 );
+			basal_rate_t( basal_rate_t const & ) = default;
+			basal_rate_t( basal_rate_t && ) = default;
+			basal_rate_t & operator=( basal_rate_t const & ) = default;
+			basal_rate_t & operator=( basal_rate_t && ) = default;
+		};	// basal_rate_t
+
+		// The 145 bytes after the header hold up to 48 [offset, rate, rate high] triples.  The
+		// offset counts 30 minute steps from midnight, the list ends at the first all zero
+		// triple after the first one
+		template<uint8_t child_op_code>
+		struct hist_change_basal_profile_entry: public history_entry_static<child_op_code, true, 152> {
+			std::vector<basal_rate_t> m_rates;
+			hist_change_basal_profile_entry( data_source_t data, pump_model_t pump_model );
+
+			virtual ~hist_change_basal_profile_entry( );
+			hist_change_basal_profile_entry( hist_change_basal_profile_entry const & ) = default;
+			hist_change_basal_profile_entry( hist_change_basal_profile_entry && ) = default;
+			hist_change_basal_profile_entry & operator=( hist_change_basal_profile_entry const & ) = default;
+			hist_change_basal_profile_entry & operator=( hist_change_basal_profile_entry && ) = default;
+		};	// hist_change_basal_profile_entry
+
+		using hist_change_basal_profile_pattern = hist_change_basal_profile_entry<0x08>;
+		using hist_change_basal_profile = hist_change_basal_profile_entry<0x09>;
 
 		struct hist_cal_bg_for_ph: public history_entry_static<0x0A, true> {
 			uint16_t m_amount;
@@ -136,7 +175,7 @@ namespace daw {
 		};	// hist_temp_basal_duration
 
 		struct hist_change_time: public history_entry_static<0x17, false, 14, 9> {
-			boost::posix_time::ptime m_old_timestamp;
+			boost::optional<boost::posix_time::ptime> m_old_timestamp;	// empty when the pump wrote an invalid time
 
 			hist_change_time( data_source_t data, pump_model_t pump_model );
 
@@ -197,14 +236,117 @@ namespace daw {
 		using hist_change_sensor_rate_of_change_alert_setup = history_entry_static<0x56, false, 12>;
 		using hist_change_bolus_scroll_step_size = history_entry_static<0x57>;
 
+		// Field positions after the 7 byte header: [0] flags, bit 0 sensor on, bit 1 high alert,
+		// bit 2 low alert, [1,2] high limit, [3,4] low limit, [5,6] calibration reminder in
+		// minutes, [7..9] transmitter id.  Low suspend pumps add [30] low suspend on and [31,32]
+		// the suspend threshold, all in mg/dL and big endian
 		struct hist_change_sensor_setup: public history_entry<0x50> {
-			hist_change_sensor_setup( data_source_t data, pump_model_t pump_model );
+			uint8_t m_enabled;
+			uint8_t m_high_alert;
+			uint8_t m_low_alert;
+			uint16_t m_high_limit;
+			uint16_t m_low_limit;
+			uint16_t m_calibration_reminder;
+			uint32_t m_transmitter_id;
+			uint8_t m_low_suspend;
+			uint16_t m_low_suspend_limit;
+
+			template<typename Traits>
+			hist_change_sensor_setup( data_source_t data, pump_model_t pump_model, Traits );
+
+			template<typename Traits>
+			static record_layout_t layout( data_source_t const & ) {
+				return record_layout_t{ Traits::has_low_suspend ? 41u : 37u, 2, 5 };
+			}
+
 			virtual ~hist_change_sensor_setup( );
+			hist_change_sensor_setup( hist_change_sensor_setup const & ) = default;
+			hist_change_sensor_setup( hist_change_sensor_setup && ) = default;
+			hist_change_sensor_setup & operator=( hist_change_sensor_setup const & ) = default;
+			hist_change_sensor_setup & operator=( hist_change_sensor_setup && ) = default;
 		};	// hist_change_sensor_setup
 
+		struct carb_ratio_t: public daw::json::JsonLink<carb_ratio_t> {
+			uint16_t m_offset;	// minutes after midnight
+			double m_ratio;	// grams per unit, or exchanges per unit
+			virtual ~carb_ratio_t( );
+			carb_ratio_t( uint16_t offset = 0, double ratio = 0.0 );
+			carb_ratio_t( carb_ratio_t const & ) = default;
+			carb_ratio_t( carb_ratio_t && ) = default;
+			carb_ratio_t & operator=( carb_ratio_t const & ) = default;
+			carb_ratio_t & operator=( carb_ratio_t && ) = default;
+		};	// carb_ratio_t
+
+		struct insulin_sensitivity_t: public daw::json::JsonLink<insulin_sensitivity_t> {
+			uint16_t m_offset;	// minutes after midnight
+			uint16_t m_sensitivity;	// bg units per unit
+			virtual ~insulin_sensitivity_t( );
+			insulin_sensitivity_t( uint16_t offset = 0, uint16_t sensitivity = 0 );
+			insulin_sensitivity_t( insulin_sensitivity_t const & ) = default;
+			insulin_sensitivity_t( insulin_sensitivity_t && ) = default;
+			insulin_sensitivity_t & operator=( insulin_sensitivity_t const & ) = default;
+			insulin_sensitivity_t & operator=( insulin_sensitivity_t && ) = default;
+		};	// insulin_sensitivity_t
+
+		struct bg_target_t: public daw::json::JsonLink<bg_target_t> {
+			uint16_t m_offset;	// minutes after midnight
+			uint16_t m_low;
+			uint16_t m_high;
+			virtual ~bg_target_t( );
+			bg_target_t( uint16_t offset = 0, uint16_t low = 0, uint16_t high = 0 );
+			bg_target_t( bg_target_t const & ) = default;
+			bg_target_t( bg_target_t && ) = default;
+			bg_target_t & operator=( bg_target_t const & ) = default;
+			bg_target_t & operator=( bg_target_t && ) = default;
+		};	// bg_target_t
+
+		// One half of a bolus wizard setup record: [0] carb units, [1] bg units, 8 carb ratios,
+		// 8 sensitivities and 8 targets, each entry led by its 30 minute offset.  Large pumps
+		// store carb ratios in 3 bytes as tenths, small pumps in 2 bytes as whole numbers, and
+		// add the insulin action time after the targets.  Unused schedule slots are dropped
+		struct bolus_wizard_settings_t: public daw::json::JsonLink<bolus_wizard_settings_t> {
+			uint8_t m_carb_units;	// 1 grams, 2 exchanges
+			uint8_t m_bg_units;	// 1 mg/dL, 2 mmol/L
+			std::vector<carb_ratio_t> m_carb_ratios;
+			std::vector<insulin_sensitivity_t> m_sensitivities;
+			std::vector<bg_target_t> m_bg_targets;
+			uint8_t m_insulin_action_hours;	// 0 when the pump does not record it
+
+			bolus_wizard_settings_t( );
+
+			template<typename Traits>
+			bolus_wizard_settings_t( uint8_t const * first, Traits );
+
+			template<typename Traits>
+			static constexpr size_t size( ) {
+				return Traits::larger ? 68u : 58u;
+			}
+
+			virtual ~bolus_wizard_settings_t( );
+			bolus_wizard_settings_t( bolus_wizard_settings_t const & ) = default;
+			bolus_wizard_settings_t( bolus_wizard_settings_t && ) = default;
+			bolus_wizard_settings_t & operator=( bolus_wizard_settings_t const & ) = default;
+			bolus_wizard_settings_t & operator=( bolus_wizard_settings_t && ) = default;
+		};	// bolus_wizard_settings_t
+
+		// The body holds the settings before and after the change, followed by a spare byte
 		struct hist_change_bolus_wizard_setup: public history_entry<0x5A> {
-			hist_change_bolus_wizard_setup( data_source_t data, pump_model_t pump_model );
+			bolus_wizard_settings_t m_old_settings;
+			bolus_wizard_settings_t m_new_settings;
+
+			template<typename Traits>
+			hist_change_bolus_wizard_setup( data_source_t data, pump_model_t pump_model, Traits );
+
+			template<typename Traits>
+			static record_layout_t layout( data_source_t const & ) {
+				return record_layout_t{ Traits::larger ? 144u : 124u, 2, 5 };
+			}
+
 			virtual ~hist_change_bolus_wizard_setup( );
+			hist_change_bolus_wizard_setup( hist_change_bolus_wizard_setup const & ) = default;
+			hist_change_bolus_wizard_setup( hist_change_bolus_wizard_setup && ) = default;
+			hist_change_bolus_wizard_setup & operator=( hist_change_bolus_wizard_setup const & ) = default;
+			hist_change_bolus_wizard_setup & operator=( hist_change_bolus_wizard_setup && ) = default;
 		};	// hist_change_bolus_wizard_setup
 
 		struct hist_bolus_wizard_estimate: public history_entry<0x5B> {
@@ -219,7 +361,14 @@ namespace daw {
 			uint8_t m_insulin_sensitivity;
 			double m_carbohydrate_ratio;
 
-			hist_bolus_wizard_estimate( data_source_t data, pump_model_t pump_model );
+			template<typename Traits>
+			hist_bolus_wizard_estimate( data_source_t data, pump_model_t pump_model, Traits );
+
+			template<typename Traits>
+			static record_layout_t layout( data_source_t const & ) {
+				return record_layout_t{ Traits::larger ? 22u : 20u, 2, 5 };
+			}
+
 			virtual ~hist_bolus_wizard_estimate( );
 		};	// hist_bolus_wizard_estimate
 
@@ -236,6 +385,12 @@ namespace daw {
 			};
 			std::vector<unabsorbed_insulin_record_t> m_records;
 			hist_unabsorbed_insulin( data_source_t data, pump_model_t pump_model );
+
+			template<typename Traits>
+			static record_layout_t layout( data_source_t const & data ) {
+				return record_layout_t{ data.size( ) > 1 && data[1] > 2 ? data[1] : 2u, 1, 0 };
+			}
+
 			virtual ~hist_unabsorbed_insulin( );
 			hist_unabsorbed_insulin( hist_unabsorbed_insulin const & ) = default;
 			hist_unabsorbed_insulin( hist_unabsorbed_insulin && ) = default;
@@ -305,6 +460,93 @@ namespace daw {
 		using hist_change_watch_dog_marriage_profile = history_entry_static<0x81, false, 12>;
 		using hist_delete_other_device_id = history_entry_static<0x82, false, 12>;
 		using hist_change_capture_event_enable = history_entry_static<0x83>;
+
+		// An op_code unknown to this decoder, framed with its overlay layout and kept as raw data
+		struct hist_overlay_entry: public history_entry_obj {
+			hist_overlay_entry( data_source_t data, pump_model_t pump_model, record_layout_t layout );
+
+			virtual ~hist_overlay_entry( );
+			hist_overlay_entry( hist_overlay_entry const & ) = default;
+			hist_overlay_entry( hist_overlay_entry && ) = default;
+			hist_overlay_entry & operator=( hist_overlay_entry const & ) = default;
+			hist_overlay_entry & operator=( hist_overlay_entry && ) = default;
+		};	// hist_overlay_entry
+
+		template<typename T>
+		struct entry_type_t {
+			using type = T;
+		};	// entry_type_t
+
+		// Calls visitor with the entry_type_t of the history entry for op_code, or returns
+		// default_result when the op_code is unknown.  This is the one table of op_codes
+		// shared by decoding and framing
+		template<typename Visitor, typename Result>
+		Result visit_history_entry_type( uint8_t op_code, Visitor && visitor, Result default_result ) {
+			switch( op_code ) {
+				case 0x00: return visitor( entry_type_t<hist_skip>{ } );
+				case 0x01: return visitor( entry_type_t<hist_bolus_normal>{ } );
+				case 0x03: return visitor( entry_type_t<hist_prime>{ } );
+				case 0x06: return visitor( entry_type_t<hist_alarm_pump>{ } );
+				case 0x07: return visitor( entry_type_t<hist_result_daily_total>{ } );
+				case 0x08: return visitor( entry_type_t<hist_change_basal_profile_pattern>{ } );
+				case 0x09: return visitor( entry_type_t<hist_change_basal_profile>{ } );
+				case 0x0A: return visitor( entry_type_t<hist_cal_bg_for_ph>{ } );
+				case 0x0B: return visitor( entry_type_t<hist_alarm_sensor>{ } );
+				case 0x0C: return visitor( entry_type_t<hist_clear_alarm>{ } );
+				case 0x14: return visitor( entry_type_t<hist_select_basal_profile>{ } );
+				case 0x16: return visitor( entry_type_t<hist_temp_basal_duration>{ } );
+				case 0x17: return visitor( entry_type_t<hist_change_time>{ } );
+				case 0x19: return visitor( entry_type_t<hist_pump_low_battery>{ } );
+				case 0x1A: return visitor( entry_type_t<hist_battery>{ } );
+				case 0x1E: return visitor( entry_type_t<hist_suspend>{ } );
+				case 0x1F: return visitor( entry_type_t<hist_resume>{ } );
+				case 0x21: return visitor( entry_type_t<hist_rewind>{ } );
+				case 0x23: return visitor( entry_type_t<hist_change_child_block_enable>{ } );
+				case 0x24: return visitor( entry_type_t<hist_change_max_bolus>{ } );
+				case 0x26: return visitor( entry_type_t<hist_enable_disable_remote>{ } );
+				case 0x2C: return visitor( entry_type_t<hist_change_max_basal>{ } );
+				case 0x31: return visitor( entry_type_t<hist_change_bg_reminder_offset>{ } );
+				case 0x32: return visitor( entry_type_t<hist_change_alarm_clock_time>{ } );
+				case 0x33: return visitor( entry_type_t<hist_temp_basal>{ } );
+				case 0x34: return visitor( entry_type_t<hist_pump_low_reservoir>{ } );
+				case 0x35: return visitor( entry_type_t<hist_alarm_clock_reminder>{ } );
+				case 0x3B: return visitor( entry_type_t<hist_questionable_3b>{ } );
+				case 0x3C: return visitor( entry_type_t<hist_change_paradigm_linkid>{ } );
+				case 0x3F: return visitor( entry_type_t<hist_bg_received>{ } );
+				case 0x40: return visitor( entry_type_t<hist_meal_marker>{ } );
+				case 0x41: return visitor( entry_type_t<hist_exercise_marker>{ } );
+				case 0x42: return visitor( entry_type_t<hist_manual_insulin_marker>{ } );
+				case 0x43: return visitor( entry_type_t<hist_other_marker>{ } );
+				case 0x50: return visitor( entry_type_t<hist_change_sensor_setup>{ } );
+				case 0x56: return visitor( entry_type_t<hist_change_sensor_rate_of_change_alert_setup>{ } );
+				case 0x57: return visitor( entry_type_t<hist_change_bolus_scroll_step_size>{ } );
+				case 0x5A: return visitor( entry_type_t<hist_change_bolus_wizard_setup>{ } );
+				case 0x5B: return visitor( entry_type_t<hist_bolus_wizard_estimate>{ } );
+				case 0x5C: return visitor( entry_type_t<hist_unabsorbed_insulin>{ } );
+				case 0x5E: return visitor( entry_type_t<hist_change_variable_bolus>{ } );
+				case 0x5F: return visitor( entry_type_t<hist_change_audio_bolus>{ } );
+				case 0x60: return visitor( entry_type_t<hist_change_bg_reminder_enable>{ } );
+				case 0x61: return visitor( entry_type_t<hist_change_alarm_clock_enable>{ } );
+				case 0x62: return visitor( entry_type_t<hist_change_temp_basal_type>{ } );
+				case 0x63: return visitor( entry_type_t<hist_change_alarm_notify_mode>{ } );
+				case 0x64: return visitor( entry_type_t<hist_change_time_format>{ } );
+				case 0x65: return visitor( entry_type_t<hist_change_reservoir_warning_time>{ } );
+				case 0x66: return visitor( entry_type_t<hist_change_bolus_reminder_enable>{ } );
+				case 0x67: return visitor( entry_type_t<hist_change_bolus_reminder_time>{ } );
+				case 0x68: return visitor( entry_type_t<hist_delete_bolus_reminder_time>{ } );
+				case 0x6A: return visitor( entry_type_t<hist_delete_alarm_clock_time>{ } );
+				case 0x6D: return visitor( entry_type_t<hist_model_522_result_totals>{ } );
+				case 0x6E: return visitor( entry_type_t<hist_sara_6e>{ } );
+				case 0x6F: return visitor( entry_type_t<hist_change_carb_units>{ } );
+				case 0x7B: return visitor( entry_type_t<hist_basal_profile_start>{ } );
+				case 0x7C: return visitor( entry_type_t<hist_change_watch_dog_enable>{ } );
+				case 0x7D: return visitor( entry_type_t<hist_change_other_device_id>{ } );
+				case 0x81: return visitor( entry_type_t<hist_change_watch_dog_marriage_profile>{ } );
+				case 0x82: return visitor( entry_type_t<hist_delete_other_device_id>{ } );
+				case 0x83: return visitor( entry_type_t<hist_change_capture_event_enable>{ } );
+				default: return default_result;
+			}
+		}
 	}	// namespace history
 }	// namespace daw
 
@@ -27,6 +27,7 @@
 #include <boost/optional.hpp>
 #include <daw/daw_range.h>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <daw/json/daw_json.h>
 #include <daw/json/daw_json_link.h>
@@ -35,15 +36,49 @@ namespace daw {
 	namespace history {
 		std::string op_string( uint8_t op_code );
 
+		// Seconds east of UTC of this process's timezone, negative west of it
+		int32_t seconds_from_gmt( );
+
+		class timezone_table;
+
 		using data_source_t = daw::range::Range<uint8_t *>;
+
+		// Record layouts only differ between these generations of pump
+		enum class pump_family_t: uint8_t {
+			small,			// x22 and earlier
+			large,			// x23 - x50
+			low_suspend		// x51 and later
+		};
+
+		// Compile time description of a pump family.  Decoders instantiated on these carry
+		// their record sizes and field offsets as constants
+		template<bool Larger, bool HasLowSuspend>
+		struct pump_traits_t {
+			static constexpr bool larger = Larger;
+			static constexpr bool has_low_suspend = HasLowSuspend;
+			static constexpr uint8_t strokes_per_unit = Larger ? 40 : 10;
+		};	// pump_traits_t
+
+		using small_pump_traits = pump_traits_t<false, false>;
+		using large_pump_traits = pump_traits_t<true, false>;
+		using low_suspend_pump_traits = pump_traits_t<true, true>;
+
+		struct record_layout_t {
+			size_t size;
+			size_t timestamp_offset;
+			size_t timestamp_size;
+		};	// record_layout_t
+
 		struct pump_model_t {
 			uint16_t generation;
 			bool larger;
 			bool has_low_suspend;
 			uint8_t strokes_per_unit;
+			std::shared_ptr<timezone_table const> timezone;	// the pump clock's zone, nullptr for this process's offset
 
 			pump_model_t( ) = delete;
 			pump_model_t( std::string const & model );
+			pump_family_t family( ) const;
 
 			virtual ~pump_model_t( );
 			pump_model_t( pump_model_t const & ) = default;
@@ -98,6 +133,11 @@ namespace daw {
 			history_entry_static( data_source_t data, pump_model_t pump_model ):
 				history_entry<child_op_code>{ std::move( data ), is_decoded, child_size, std::move( pump_model ), child_timestamp_offset, child_timestamp_size } { }
 
+			template<typename Traits>
+			static record_layout_t layout( data_source_t const & ) {
+				return record_layout_t{ child_size, child_timestamp_offset, child_timestamp_size };
+			}
+
 			virtual ~history_entry_static( ) = default;
 			history_entry_static( history_entry_static const & ) = default;
 			history_entry_static( history_entry_static && ) = default;
@@ -107,6 +147,36 @@ namespace daw {
 
 		std::ostream & operator<<( std::ostream & os, history_entry_obj const & entry );
 
+		// Layouts for op_codes this decoder does not know, usually loaded from a file written by
+		// opcode_learner.  Set them before decoding starts, they are read without synchronisation
+		void set_opcode_overlay( uint8_t op_code, record_layout_t layout );
+		void clear_opcode_overlays( );
+		boost::optional<record_layout_t> get_opcode_overlay( uint8_t op_code );
+		// Changes whenever the overlays do, 0 when none are set
+		uint64_t opcode_overlay_hash( );
+
+		// Decodes the entry at the front of data and advances data and position past it.  Returns
+		// nullptr, leaving data untouched, when no entry can be decoded there
+		template<typename Traits>
+		std::unique_ptr<history_entry_obj> create_history_entry( data_source_t & data, pump_model_t const & pump_model, size_t & position );
+
+		// Size and timestamp position of the entry at the front of data without decoding it.
+		// Empty when the op_code is unknown or the entry does not fit in data
+		template<typename Traits>
+		boost::optional<record_layout_t> frame_history_entry( data_source_t const & data );
+
+		// Range checks the timestamp fields of a framed entry without building a ptime
+		bool has_valid_timestamp( data_source_t const & data, record_layout_t const & layout );
+
+		// The UTC timestamp of a framed entry, as history_entry_obj::timestamp( ) would report it
+		// for a pump clock in zone
+		boost::optional<boost::posix_time::ptime> parse_history_timestamp( data_source_t const & data, record_layout_t const & layout, timezone_table const * zone );
+
+		using history_decoder_t = std::unique_ptr<history_entry_obj>(*)( data_source_t & data, pump_model_t const & pump_model, size_t & position );
+
+		// Select the create_history_entry instantiation for a model once, at the start of a session
+		history_decoder_t get_history_decoder( pump_model_t const & pump_model );
+
 		std::unique_ptr<history_entry_obj> create_history_entry( data_source_t & data, pump_model_t pump_model, size_t & position );
 	}	// namespace history
 }	// namespace daw
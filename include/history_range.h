@@ -0,0 +1,96 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/optional.hpp>
+#include <iterator>
+#include <memory>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		class history_range;
+
+		// A framed entry, or an unrecognised span, of a page.  Nothing is decoded until asked for.
+		// Views refer to their history_range and the page, both must outlive them
+		class history_record_view {
+			history_range const * m_range;
+			history_frame_t m_frame;
+		public:
+			history_record_view( history_range const * range, history_frame_t frame );
+
+			bool is_error( ) const;
+			uint8_t op_code( ) const;
+			size_t offset( ) const;
+			size_t size( ) const;
+			record_layout_t layout( ) const;
+			data_source_t data( ) const;
+			boost::optional<boost::posix_time::ptime> timestamp( ) const;
+			// nullptr for an error span
+			std::unique_ptr<history_entry_obj> decode( ) const;
+		};	// history_record_view
+
+		// Lazily frames a page, yielding a history_record_view per entry or unrecognised span and
+		// skipping padding.  Framing is repeatable, so the range can be walked more than once
+		class history_range {
+			data_source_t m_page;
+			pump_model_t m_pump_model;
+			history_framer m_framer;
+			history_decoder_t m_decoder;
+
+			friend class history_record_view;
+		public:
+			class iterator {
+				history_range const * m_range;
+				size_t m_offset;
+				history_frame_t m_frame;
+
+				void skip_padding( );
+			public:
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = history_record_view;
+				using difference_type = std::ptrdiff_t;
+				using pointer = history_record_view const *;
+				using reference = history_record_view;
+
+				iterator( history_range const * range, size_t offset );
+				history_record_view operator*( ) const;
+				iterator & operator++( );
+				iterator operator++( int );
+				friend bool operator==( iterator const & lhs, iterator const & rhs );
+				friend bool operator!=( iterator const & lhs, iterator const & rhs );
+			};	// iterator
+
+			history_range( data_source_t page, pump_model_t pump_model, framing_options_t options = framing_options_t{ } );
+			iterator begin( ) const;
+			iterator end( ) const;
+			data_source_t const & page( ) const;
+			pump_model_t const & pump_model( ) const;
+		};	// history_range
+
+		// for( auto && rec : decode( page, pump_model ) ) { ... }
+		// page excludes the CRC
+		history_range decode( data_source_t page, pump_model_t pump_model, framing_options_t options = framing_options_t{ } );
+	}	// namespace history
+}	// namespace daw
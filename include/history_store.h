@@ -0,0 +1,152 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "history_decode.h"
+#include "history_merge.h"
+
+namespace daw {
+	namespace history {
+		// A pump's history store is three append only files
+		//	<path>		header followed by fixed size records sorted by timestamp
+		//	<path>.raw	the raw bytes of each record
+		//	<path>.idx	sparse index with the time range and op_codes of each full block of records
+		// and <path>.state holds the pump state checkpoints of those records, see pump_state.h
+		// The record count in the header is written last, readers never look past it and so
+		// need no lock against the single writer
+		struct store_record_t {
+			int64_t timestamp;	// carried forward from the previous record when it has none
+			uint64_t data_offset;
+			uint16_t size;
+			uint8_t op_code;
+			uint8_t has_timestamp;
+			uint8_t reserved[4];
+		};	// store_record_t
+
+		struct store_block_t {
+			int64_t min_timestamp;
+			int64_t max_timestamp;
+			uint64_t first_record;
+			uint64_t op_codes[4];	// bitmap of the op_codes present
+		};	// store_block_t
+
+		struct store_header_t {
+			uint64_t magic;
+			uint32_t version;
+			uint32_t records_per_block;
+			uint64_t record_count;
+			uint64_t reserved[5];
+		};	// store_header_t
+
+		struct history_store_record_t {
+			int64_t timestamp;
+			bool has_timestamp;
+			uint8_t op_code;
+			uint8_t const * data;
+			size_t size;
+		};	// history_store_record_t
+
+		struct history_store_append_t {
+			size_t appended;
+			size_t duplicates;		// already in the store
+			size_t out_of_order;	// older than the newest record stored and not in the store
+			std::vector<size_t> records;	// indices into the batch of the records appended, in store order
+		};	// history_store_append_t
+
+		class history_store_writer {
+			std::string m_path;
+			std::fstream m_records;
+			std::fstream m_raw;
+			std::fstream m_index;
+			uint64_t m_count;
+			uint64_t m_committed;	// the record count in the header
+			uint64_t m_raw_size;
+			uint32_t m_records_per_block;
+			store_block_t m_block;
+			int64_t m_last_timestamp;
+			bool m_positioned;	// the files are positioned to append, a commit moves the header's
+
+			void open_existing( );
+			void create_new( );
+			void seek_end( );
+			void add_record( int64_t timestamp, bool has_timestamp, uint8_t const * data, size_t size );
+			void commit( );
+			// Keys of the stored records timestamped at or after first_timestamp
+			std::unordered_set<history_key_t, history_key_hash_t> stored_keys( int64_t first_timestamp );
+		public:
+			explicit history_store_writer( std::string path, uint32_t records_per_block = 512 );
+
+			// Records are added in timestamp order.  A batch is sorted first and the records
+			// already stored, matched on op_code, timestamp and data, are skipped as are those older
+			// than the newest record stored.  A batch is committed when it is appended, single
+			// entries a block at a time.  A single entry returns false when it is not added
+			history_store_append_t append( history_record_table_t const & records );
+			bool append( history_entry_obj const & entry );
+			// Commits the entries appended since the last commit, destroying the writer does too
+			void flush( );
+			size_t size( ) const;
+
+			~history_store_writer( );
+			history_store_writer( history_store_writer const & ) = delete;
+			history_store_writer( history_store_writer && ) = default;
+			history_store_writer & operator=( history_store_writer const & ) = delete;
+			history_store_writer & operator=( history_store_writer && ) = default;
+		};	// history_store_writer
+
+		class history_store_reader {
+			std::string m_path;
+			boost::iostreams::mapped_file_source m_records;
+			boost::iostreams::mapped_file_source m_raw;
+			boost::iostreams::mapped_file_source m_index;
+			uint64_t m_count;
+			uint32_t m_records_per_block;
+
+			store_record_t const * records( ) const;
+			store_block_t const * blocks( ) const;
+			size_t block_count( ) const;
+			void scan( size_t first, size_t last, uint8_t op_code, int64_t first_timestamp, int64_t last_timestamp, std::vector<history_store_record_t> & result ) const;
+		public:
+			explicit history_store_reader( std::string path );
+
+			// Remaps the files to pick up records committed since the last refresh
+			void refresh( );
+			size_t size( ) const;
+
+			// All records of op_code timestamped within [first_timestamp, last_timestamp], in
+			// seconds since the epoch.  The data pointers are valid until the next refresh( )
+			std::vector<history_store_record_t> find( uint8_t op_code, int64_t first_timestamp, int64_t last_timestamp ) const;
+
+			~history_store_reader( );
+			history_store_reader( history_store_reader const & ) = delete;
+			history_store_reader( history_store_reader && ) = default;
+			history_store_reader & operator=( history_store_reader const & ) = delete;
+			history_store_reader & operator=( history_store_reader && ) = default;
+		};	// history_store_reader
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,119 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "history_pages_base.h"
+
+namespace daw {
+	namespace history {
+		constexpr int64_t const iob_step_seconds = 5*60;
+
+		struct insulin_curve_t {
+			uint32_t dia_minutes;	// duration of insulin action
+			uint32_t peak_minutes;
+
+			insulin_curve_t( );
+			insulin_curve_t( uint32_t dia, uint32_t peak );
+
+			// The curve needs a peak after delivery and well inside the action duration
+			bool valid( ) const;
+		};	// insulin_curve_t
+
+		// Fraction of a dose still on board at each 5 minute step after delivery, using the
+		// exponential action curve from oref0.  Evaluated once so computing IOB is a lookup
+		class iob_curve_table {
+			insulin_curve_t m_curve;
+			std::vector<double> m_remaining;
+		public:
+			// Throws std::invalid_argument when curve is not valid( )
+			explicit iob_curve_table( insulin_curve_t curve = insulin_curve_t{ } );
+			// 1.0 at 0 minutes, 0.0 from the end of the action duration on
+			double remaining( double minutes ) const;
+			std::vector<double> const & steps( ) const;
+			insulin_curve_t const & curve( ) const;
+		};	// iob_curve_table
+
+		struct insulin_dose_t {
+			int64_t epoch;	// seconds since the epoch in UTC
+			double amount;
+			uint32_t duration_minutes;	// extended boluses are delivered evenly over this
+		};	// insulin_dose_t
+
+		// What the pump said was on board at a point in time
+		struct iob_reference_t {
+			int64_t epoch;
+			double reported;
+		};	// iob_reference_t
+
+		struct insulin_history_t {
+			std::vector<insulin_dose_t> doses;
+			std::vector<iob_reference_t> references;
+			int64_t latest;	// newest timestamp of any entry
+		};	// insulin_history_t
+
+		// Doses from the normal bolus entries, and the pump's own unabsorbed insulin totals from
+		// the bolus and unabsorbed insulin entries.  An unabsorbed insulin entry has no
+		// timestamp and is given the next one in the stream.  Entries can be dropped once added
+		class insulin_history_collector {
+			insulin_history_t m_history;
+			bool m_has_pending_total;
+			double m_pending_total;
+		public:
+			insulin_history_collector( );
+			void add( history_entry_obj const & entry );
+			// Everything collected, oldest first
+			insulin_history_t take( );
+		};	// insulin_history_collector
+
+		insulin_history_t collect_insulin_history( std::vector<std::unique_ptr<history_entry_obj>> const & entries );
+
+		struct iob_series_t {
+			int64_t start;	// epoch of iob[0]
+			std::vector<double> iob;
+
+			int64_t epoch( size_t n ) const;
+			// The step at or before epoch, clamped to the series
+			double at( int64_t epoch ) const;
+		};	// iob_series_t
+
+		// IOB on a 5 minute grid from start to end.  Doses are put on the grid and the table is
+		// convolved over it, so the cost depends on the length of the grid and the action
+		// duration rather than the number of doses.  A step includes doses given at or before it
+		iob_series_t compute_iob( std::vector<insulin_dose_t> const & doses, int64_t start, int64_t end, iob_curve_table const & table );
+
+		// The same result evaluating every dose at every step, for checking compute_iob
+		iob_series_t compute_iob_naive( std::vector<insulin_dose_t> const & doses, int64_t start, int64_t end, iob_curve_table const & table );
+
+		struct iob_validation_t {
+			size_t compared;
+			double mean_abs_error;
+			double max_abs_error;
+		};	// iob_validation_t
+
+		// Compares the series, just before each reference, with what the pump reported
+		iob_validation_t validate_iob( iob_series_t const & series, std::vector<iob_reference_t> const & references );
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,93 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace daw {
+	namespace history {
+		struct memory_stage_usage_t {
+			std::string name;
+			size_t used;
+			size_t peak;
+		};	// memory_stage_usage_t
+
+		// Accounts for the memory held by each stage of a decode against a shared limit.  Only
+		// the stage taking in new data should wait for room; the stages after it account for
+		// what they hold without waiting, so they can always drain and release
+		class memory_budget {
+			struct stage_t {
+				std::string name;
+				std::atomic<size_t> used;
+				std::atomic<size_t> peak;
+
+				explicit stage_t( std::string stage_name );
+			};	// stage_t
+
+			size_t m_limit;
+			std::atomic<size_t> m_used;
+			std::atomic<size_t> m_peak;
+			std::vector<std::unique_ptr<stage_t>> m_stages;
+			std::mutex m_mutex;
+			std::condition_variable m_released;
+
+			void account( size_t stage, size_t bytes );
+		public:
+			// A limit of 0 never refuses or waits, only tracking use
+			explicit memory_budget( size_t limit );
+
+			// Add every stage before sharing the budget between threads
+			size_t add_stage( std::string name );
+
+			// Takes bytes if they fit under the limit
+			bool try_reserve( size_t stage, size_t bytes );
+			// Waits until bytes fit.  A reservation larger than the whole limit is let through
+			// once nothing else is held, rather than waiting forever
+			void reserve( size_t stage, size_t bytes );
+			// Takes bytes whether or not they fit
+			void force_reserve( size_t stage, size_t bytes );
+			void release( size_t stage, size_t bytes );
+
+			size_t limit( ) const;
+			size_t used( ) const;
+			size_t peak( ) const;
+			std::vector<memory_stage_usage_t> usage( ) const;
+
+			memory_budget( memory_budget const & ) = delete;
+			memory_budget & operator=( memory_budget const & ) = delete;
+			~memory_budget( );
+		};	// memory_budget
+
+		// Parses sizes like 512M or 2G, 0 when invalid
+		size_t parse_memory_size( std::string const & text );
+
+		// High water mark of the process's resident memory, 0 where unavailable
+		size_t peak_resident_bytes( );
+	}	// namespace history
+}	// namespace daw
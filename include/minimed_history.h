@@ -0,0 +1,97 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// C interface to the history decoder for embedding it in other programs.  A session is made
+// for a pump model, fed history pages as they arrive, and its records read back one at a time.
+// A session must only be used by one thread at a time, separate sessions are independent
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined( _WIN32 )
+	#if defined( MINIMED_HISTORY_BUILD )
+		#define MINIMED_HISTORY_API __declspec( dllexport )
+	#elif defined( MINIMED_HISTORY_SHARED )
+		#define MINIMED_HISTORY_API __declspec( dllimport )
+	#else
+		#define MINIMED_HISTORY_API
+	#endif
+#else
+	#define MINIMED_HISTORY_API __attribute__( ( visibility( "default" ) ) )
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	typedef enum minimed_history_status {
+		MINIMED_HISTORY_OK = 0,
+		MINIMED_HISTORY_END = 1,	// no more records until more pages are fed
+		MINIMED_HISTORY_INVALID_ARGUMENT = -1,
+		MINIMED_HISTORY_INVALID_MODEL = -2,
+		MINIMED_HISTORY_OUT_OF_MEMORY = -3,
+		MINIMED_HISTORY_INTERNAL_ERROR = -4,
+		MINIMED_HISTORY_INVALID_ZONE = -5
+	} minimed_history_status;
+
+	enum {
+		MINIMED_HISTORY_RECORD_ERROR = 1,	// bytes that could not be framed as an entry
+		MINIMED_HISTORY_RECORD_BAD_CRC = 2	// the page's CRC did not match
+	};
+
+	typedef struct minimed_history_record {
+		int64_t timestamp;	// seconds since the epoch in UTC, INT64_MIN when there is none
+		uint8_t const * data;	// valid until the next call on the session, NULL for errors
+		uint32_t size;
+		uint32_t page;	// counted from the first page fed to the session
+		uint32_t offset;	// within the page
+		uint8_t op_code;
+		uint8_t flags;
+	} minimed_history_record;
+
+	typedef struct minimed_history_session minimed_history_session;
+
+	// model is the pump model number such as "523".  zone is the timezone the pump clock was set
+	// in, a tzdata name such as "America/Toronto" or a POSIX TZ string, and record timestamps are
+	// converted from it to UTC.  When zone is NULL the pump clock is taken to be in this process's
+	// local time
+	MINIMED_HISTORY_API minimed_history_status minimed_history_create( char const * model, char const * zone, minimed_history_session ** session );
+
+	// Whole pages of 1024 bytes including their CRC.  Bytes past the last whole page are held
+	// until the rest of the page is fed
+	MINIMED_HISTORY_API minimed_history_status minimed_history_feed( minimed_history_session * session, uint8_t const * bytes, size_t size );
+
+	// MINIMED_HISTORY_OK and the next record in page order, or MINIMED_HISTORY_END
+	MINIMED_HISTORY_API minimed_history_status minimed_history_next( minimed_history_session * session, minimed_history_record * record );
+
+	// The record decoded to JSON, NUL terminated and valid until the next call on the session
+	MINIMED_HISTORY_API minimed_history_status minimed_history_record_json( minimed_history_session * session, minimed_history_record const * record, char const ** json );
+
+	MINIMED_HISTORY_API void minimed_history_destroy( minimed_history_session * session );
+
+	MINIMED_HISTORY_API char const * minimed_history_status_string( minimed_history_status status );
+
+#ifdef __cplusplus
+}
+#endif
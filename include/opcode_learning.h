@@ -0,0 +1,65 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		struct learned_opcode_t {
+			uint8_t op_code;
+			record_layout_t layout;
+			size_t occurrences;
+			// share of the occurrences that agreed on layout.size
+			double confidence;
+		};	// learned_opcode_t
+
+		// Infers fixed layouts for op_codes the decoder does not know.  At each unknown op_code
+		// every candidate length is tried and the one after which the most following entries
+		// frame is voted for, along with the offset of a valid timestamp inside it
+		class opcode_learner {
+			history_framer m_framer;
+			size_t m_max_size;
+			std::map<std::pair<uint8_t, size_t>, size_t> m_size_votes;
+			std::map<std::tuple<uint8_t, size_t, size_t>, size_t> m_timestamp_votes;
+
+			size_t frames_after( data_source_t const & page, uint8_t op_code, size_t size, size_t padding_start ) const;
+		public:
+			explicit opcode_learner( pump_model_t const & pump_model, size_t max_size = 64 );
+			// page excludes the CRC
+			void add_page( data_source_t const & page );
+			std::vector<learned_opcode_t> results( size_t min_occurrences = 2 ) const;
+		};	// opcode_learner
+
+		// One op_code per line: op_code size timestamp_offset timestamp_size, op_code in hex
+		bool save_opcode_overlay( std::string const & file_name, std::vector<learned_opcode_t> const & opcodes );
+
+		// Registers the layouts in file_name with set_opcode_overlay
+		bool load_opcode_overlay( std::string const & file_name );
+	}	// namespace history
+}	// namespace daw
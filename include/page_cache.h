@@ -0,0 +1,126 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		// A decoded page cache is one memory mapped file of fixed size slots, grouped into sets
+		// of cache_ways slots.  A page's key picks its set and the least recently used slot in
+		// the set is replaced.  Processes share the file under a lock on <path>.lock, readers
+		// sharing it and writers holding it alone.  A slot's key is cleared while it is rewritten, so a
+		// crash mid write leaves an empty slot
+		constexpr uint32_t const cache_ways = 8;
+		constexpr uint32_t const cache_slot_size = 4096;
+
+		// One framed span of a page.  Pages with more than fit in a slot are not cached
+		struct cached_record_t {
+			int64_t timestamp;	// no_timestamp when it has none
+			uint16_t offset;
+			uint16_t size;
+			uint8_t op_code;
+			history_frame_kind_t kind;
+			uint8_t timestamp_offset;
+			uint8_t timestamp_size;
+		};	// cached_record_t
+
+		struct cache_header_t {
+			uint64_t magic;
+			uint32_t version;
+			uint32_t sets;
+			std::atomic<uint64_t> clock;
+			std::atomic<uint64_t> hits;
+			std::atomic<uint64_t> misses;
+			std::atomic<uint64_t> inserts;
+			std::atomic<uint64_t> evictions;
+			uint64_t reserved[1];
+		};	// cache_header_t
+
+		struct cache_slot_t {
+			std::atomic<uint64_t> key;	// 0 when empty
+			std::atomic<uint64_t> last_used;
+			uint32_t count;
+			page_status_t status;
+			uint8_t reserved[3];
+		};	// cache_slot_t
+
+		struct page_cache_stats_t {
+			uint64_t hits;
+			uint64_t misses;
+			uint64_t inserts;
+			uint64_t evictions;
+		};	// page_cache_stats_t
+
+		// Hashes 8 bytes at a time, much faster than FNV-1a over a whole page
+		uint64_t hash_page( data_source_t const & page ) noexcept;
+
+		class page_cache {
+			std::string m_path;
+			boost::interprocess::file_lock m_lock;
+			boost::interprocess::mapped_region m_region;
+			// file locks are per process, this orders the threads within one
+			std::mutex m_mutex;
+
+			cache_header_t & header( ) const;
+			cache_slot_t & slot( size_t n ) const;
+			cached_record_t * records( cache_slot_t & s ) const;
+		public:
+			// Opens the cache at path, creating it with room for about capacity bytes if needed.
+			// An existing cache keeps its size
+			explicit page_cache( std::string path, size_t capacity = 64*1024*1024 );
+
+			// page is the bytes decoded, with or without its CRC as long as it is always the same.
+			// The framing options, the op_code overlays loaded and the zone timestamps are converted
+			// from, or this process's UTC offset without one, are part of the key.  Pages framed
+			// differently are cached apart
+			bool lookup( data_source_t const & page, pump_model_t const & pump_model, framing_options_t const & options, std::vector<cached_record_t> & records, page_status_t & status );
+			void store( data_source_t const & page, pump_model_t const & pump_model, framing_options_t const & options, std::vector<cached_record_t> const & records, page_status_t status );
+
+			// Counted across every process using the cache
+			page_cache_stats_t stats( ) const;
+			size_t slots( ) const;
+
+			page_cache( page_cache const & ) = delete;
+			page_cache & operator=( page_cache const & ) = delete;
+			~page_cache( );
+		};	// page_cache
+
+		// Frames a page without its CRC, skipping padding
+		void frame_page( data_source_t const & body, history_framer const & framer, std::vector<cached_record_t> & records );
+
+		history_frame_t to_frame( cached_record_t const & record );
+
+		// decode_history_download, taking pages already seen from the cache without framing them
+		history_download_t decode_history_download( data_source_t const * first_page, data_source_t const * last_page, pump_model_t const & pump_model, page_cache & cache, framing_options_t const & options = framing_options_t{ } );
+
+		history_download_t decode_history_download( data_source_t download, pump_model_t const & pump_model, page_cache & cache, framing_options_t const & options = framing_options_t{ } );
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,56 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		struct parallel_framing_options_t {
+			size_t threads;	// 0 for one per core
+			size_t min_chunk_size;
+			// Offsets from each chunk start that a chain is framed from before the real
+			// boundary is known
+			size_t candidates;
+
+			parallel_framing_options_t( );
+		};	// parallel_framing_options_t
+
+		struct parallel_framing_stats_t {
+			size_t chunks;
+			size_t stitched;	// chunks entered on an offset a candidate chain had framed
+			size_t reframed_bytes;	// framed again on the stitching thread
+		};	// parallel_framing_stats_t
+
+		// The records and unrecognised spans of buffer, exactly as history_range yields them.
+		// The buffer is split into chunks and each chunk is framed from several candidate offsets
+		// at once.  history_framer::next( ) only depends on the offset, so chains that meet are
+		// the same from there on.  The chunks are then stitched in order: where the previous
+		// chunk's last frame ends is the real start of the next, and that chunk's chain is
+		// followed from it.  A start no candidate reached is framed on the stitching thread until
+		// it meets a chain
+		std::vector<history_frame_t> frame_history_parallel( data_source_t const & buffer, history_framer const & framer, parallel_framing_options_t const & options = parallel_framing_options_t{ }, parallel_framing_stats_t * stats = nullptr );
+	}	// namespace history
+}	// namespace daw
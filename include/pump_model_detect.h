@@ -0,0 +1,49 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/optional.hpp>
+#include "history_pages_base.h"
+
+namespace daw {
+	namespace history {
+		struct pump_model_guess_t {
+			pump_family_t family;
+			// How far the winning family scored above the next family that frames the page
+			// differently, from 0 (no evidence) to 1
+			double confidence;
+			// Framing score of each family in pump_family_t order, from 0 to 1
+			double scores[3];
+		};	// pump_model_guess_t
+
+		// Trial frames page under each pump family and scores how much of it frames cleanly
+		// with valid timestamps.  Only sizes are looked up, nothing is decoded.  Ties go to hint
+		pump_model_guess_t detect_pump_family( data_source_t page, boost::optional<pump_family_t> hint = boost::optional<pump_family_t>{ } );
+
+		std::string to_string( pump_family_t family );
+
+		// Keeps claimed when its family agrees with the page contents, otherwise returns a
+		// representative model of the detected family
+		pump_model_t resolve_pump_model( data_source_t page, boost::optional<pump_model_t> const & claimed, pump_model_guess_t * guess = nullptr );
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,133 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		// Suspend, resume, profile selection, temp basals, rewinds, primes and the other records
+		// that change what the pump is doing rather than log a delivery
+		bool is_pump_state_op_code( uint8_t op_code );
+
+		// What the pump was doing and how it was set up after a record.  Times are seconds since
+		// the epoch in UTC, no_timestamp when there has not been such a record
+		struct pump_state_t {
+			int64_t epoch;	// the last record applied
+			int64_t suspended_since;	// no_timestamp while running
+			int64_t temp_basal_start;
+			int64_t temp_basal_end;	// no_timestamp when no temp basal is running
+			int64_t last_rewind;
+			int64_t last_prime;
+			int64_t last_battery_change;
+			int64_t last_low_battery;
+			int64_t last_low_reservoir;
+			uint16_t temp_basal_rate;	// 0.025 U/h steps or percent, as temp_basal_percent says
+			uint16_t basal_rate;	// 0.025 U/h steps, of the last profile segment started
+			uint16_t last_prime_amount;	// 0.025 U steps
+			uint8_t basal_profile;	// 0 standard, 1 pattern A, 2 pattern B
+			bool temp_basal_percent;	// the last temp basal given
+			bool temp_basal_type_percent;	// the temp basal type setting
+			bool time_format_24hr;
+
+			pump_state_t( );
+
+			bool suspended( ) const;
+			bool temp_basal_running( ) const;
+		};	// pump_state_t
+
+		static_assert( std::is_trivially_copyable<pump_state_t>::value, "pump_state_t checkpoints are copied as is" );
+
+		struct pump_state_event_t {
+			int64_t epoch;
+			uint8_t op_code;
+			uint8_t args[2];	// the record bytes the reducer reads
+		};	// pump_state_event_t
+
+		// Applies one record to state
+		void apply_pump_state( pump_state_t & state, pump_state_event_t const & event );
+
+		struct pump_state_options_t {
+			size_t checkpoint_events;	// events between checkpoints
+			int64_t checkpoint_seconds;	// or time, whichever comes first
+
+			pump_state_options_t( );
+		};	// pump_state_options_t
+
+		struct pump_state_stats_t {
+			size_t records;	// pump state records given to add
+			size_t out_of_order;
+			size_t events;
+			size_t checkpoints;
+		};	// pump_state_stats_t
+
+		// Keeps the pump state records as events and the state after every checkpoint_events
+		// events or checkpoint_seconds.  The state at a time is the nearest checkpoint before
+		// it with the events after it replayed, so a query replays at most checkpoint_events
+		// however long the history is
+		class pump_state_history {
+			struct checkpoint_t {
+				size_t next_event;	// the first event not applied to state
+				pump_state_t state;
+			};	// checkpoint_t
+
+			pump_state_options_t m_options;
+			std::vector<pump_state_event_t> m_events;
+			std::vector<checkpoint_t> m_checkpoints;
+			pump_state_t m_latest;
+			pump_state_stats_t m_stats;
+		public:
+			explicit pump_state_history( pump_state_options_t options = pump_state_options_t{ } );
+
+			// Records must be added oldest first.  False when entry is not a pump state record,
+			// has no timestamp or is older than the last one added
+			bool add( history_entry_obj const & entry );
+			bool add( uint8_t op_code, int64_t epoch, std::vector<uint8_t> const & record );
+
+			// The state after every record up to and including epoch.  A temp basal that had
+			// ended by epoch is not running
+			pump_state_t at( int64_t epoch ) const;
+			pump_state_t const & latest( ) const;
+
+			std::vector<pump_state_event_t> const & events( ) const;
+			pump_state_stats_t const & stats( ) const;
+
+			// Writes the events and checkpoints to path, replacing it.  store_records is the
+			// number of history store records they were built from
+			void save( std::string const & path, uint64_t store_records ) const;
+			// Replaces the contents with what save wrote to path.  False when there is no such
+			// file or it was built from other than store_records records
+			bool load( std::string const & path, uint64_t store_records );
+		};	// pump_state_history
+
+		// The pump state of the records in the history store at store_path.  It is read from
+		// <store_path>.state when that is current and rebuilt from the store's records otherwise
+		pump_state_history load_store_pump_state( std::string const & store_path );
+		// Writes <store_path>.state for a history store holding store_records records
+		void save_store_pump_state( pump_state_history const & history, std::string const & store_path, uint64_t store_records );
+	}	// namespace history
+}	// namespace daw
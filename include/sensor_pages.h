@@ -0,0 +1,89 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "history_decode.h"
+
+namespace daw {
+	namespace history {
+		// Glucose pages hold one byte readings every 5 minutes between a few timestamped events.
+		// Event op codes are below 0x14 and come last in their entry, so a page can only be
+		// framed from the end.  A timestamp is 4 bytes at the start of an entry:
+		//	byte 0: month bits 3-2 in bits 7-6, hour in bits 4-0
+		//	byte 1: month bits 1-0 in bits 7-6, minute in bits 5-0
+		//	byte 2: timestamp type in bits 6-5, day in bits 4-0
+		//	byte 3: year - 2000 in bits 6-0
+		constexpr uint8_t const sensor_glucose_min_op = 0x14;
+		constexpr uint8_t const sensor_timestamp_op = 0x08;
+		constexpr int64_t const sensor_reading_interval = 5*60;
+
+		namespace sensor_flags {
+			// Timed forward from an earlier sensor timestamp rather than back from a later one
+			constexpr uint8_t const extrapolated = 0x01;
+			constexpr uint8_t const weak_signal = 0x02;
+			constexpr uint8_t const calibration = 0x04;
+			// No sensor timestamp on the page, epoch is no_timestamp
+			constexpr uint8_t const untimed = 0x08;
+		}	// namespace sensor_flags
+
+		struct sensor_glucose_t {
+			int64_t epoch;	// seconds since the epoch in UTC or no_timestamp
+			uint16_t mg_dl;
+			uint8_t flags;
+		};	// sensor_glucose_t
+
+		struct sensor_event_t {
+			int64_t epoch;	// no_timestamp for events without one
+			uint32_t page;
+			uint32_t offset;
+			uint8_t op_code;
+			uint8_t size;
+		};	// sensor_event_t
+
+		struct sensor_download_t {
+			std::vector<sensor_glucose_t> glucose;	// oldest first
+			std::vector<sensor_event_t> events;
+			std::vector<history_error_span_t> errors;
+			std::vector<history_page_status_t> pages;
+		};	// sensor_download_t
+
+		std::string sensor_op_string( uint8_t op_code );
+
+		// Size of the event entry ending in op_code, 0 when unknown
+		uint8_t sensor_event_size( uint8_t op_code ) noexcept;
+
+		// data is the 4 timestamp bytes of an entry
+		boost::optional<boost::posix_time::ptime> parse_sensor_timestamp( data_source_t const & data ) noexcept;
+
+		// Each page includes its CRC.  Times are converted to UTC in zone, or at this process's
+		// offset when it is nullptr
+		sensor_download_t decode_sensor_download( data_source_t const * first_page, data_source_t const * last_page, timezone_table const * zone = nullptr );
+
+		sensor_download_t decode_sensor_download( data_source_t download, timezone_table const * zone = nullptr );
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,88 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include "history_pages_base.h"
+
+namespace daw {
+	namespace history {
+		// Basal profiles, the bolus wizard setup and the sensor setup.  These records are large,
+		// are written whenever the pump settings are saved and usually repeat the last ones
+		bool is_settings_op_code( uint8_t op_code );
+
+		struct settings_byte_run_t {
+			uint16_t offset;
+			std::vector<uint8_t> bytes;
+		};	// settings_byte_run_t
+
+		struct settings_change_t {
+			int64_t epoch;
+			std::vector<uint8_t> checkpoint;	// the whole record, empty when runs holds a delta
+			std::vector<settings_byte_run_t> runs;	// bytes that differ from the previous change
+		};	// settings_change_t
+
+		struct settings_history_stats_t {
+			size_t records;	// settings records given to add
+			size_t unchanged;	// the same as the settings already in effect, not kept
+			size_t out_of_order;
+			size_t record_bytes;	// size of the records kept
+			size_t stored_bytes;	// what is stored for them
+		};	// settings_history_stats_t
+
+		// Keeps each settings record as the bytes that differ from the previous one with the same
+		// op_code, and the whole record every checkpoint_interval changes.  The settings in
+		// effect at a time are rebuilt from the nearest checkpoint and at most that many deltas
+		class settings_history {
+			struct track_t {
+				std::vector<uint8_t> latest;
+				std::vector<settings_change_t> changes;
+				size_t since_checkpoint;
+			};	// track_t
+
+			pump_model_t m_pump_model;
+			size_t m_checkpoint_interval;
+			std::map<uint8_t, track_t> m_tracks;
+			settings_history_stats_t m_stats;
+
+			std::vector<uint8_t> rebuild( track_t const & track, size_t change ) const;
+		public:
+			explicit settings_history( pump_model_t pump_model, size_t checkpoint_interval = 16 );
+
+			// Records must be added oldest first for each op_code.  False when entry is not a
+			// settings record, has no timestamp or is older than the last one added
+			bool add( history_entry_obj const & entry );
+			bool add( uint8_t op_code, int64_t epoch, std::vector<uint8_t> const & record );
+
+			// The op_code's record in effect at epoch, nullptr before the first one
+			std::unique_ptr<history_entry_obj> at( uint8_t op_code, int64_t epoch ) const;
+
+			std::vector<uint8_t> op_codes( ) const;
+			std::vector<settings_change_t> const & changes( uint8_t op_code ) const;
+			settings_history_stats_t const & stats( ) const;
+		};	// settings_history
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,101 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace daw {
+	// Bounded lock free queue for exactly one producer thread and one consumer thread.  push
+	// waits while the queue is full, which is the backpressure on a faster producer
+	template<typename T>
+	class spsc_queue {
+		std::vector<T> m_items;
+		alignas( 64 ) std::atomic<size_t> m_head;	// next to pop, owned by the consumer
+		alignas( 64 ) std::atomic<size_t> m_tail;	// next to push, owned by the producer
+		alignas( 64 ) std::atomic<bool> m_closed;
+
+	public:
+		explicit spsc_queue( size_t capacity ):
+				m_items( capacity + 1 ),
+				m_head{ 0 },
+				m_tail{ 0 },
+				m_closed{ false } {
+
+			assert( capacity > 0 );
+		}
+
+		bool try_push( T & value ) {
+			auto const tail = m_tail.load( std::memory_order_relaxed );
+			auto const next = (tail + 1) % m_items.size( );
+			if( next == m_head.load( std::memory_order_acquire ) ) {
+				return false;
+			}
+			m_items[tail] = std::move( value );
+			m_tail.store( next, std::memory_order_release );
+			return true;
+		}
+
+		bool try_pop( T & value ) {
+			auto const head = m_head.load( std::memory_order_relaxed );
+			if( head == m_tail.load( std::memory_order_acquire ) ) {
+				return false;
+			}
+			value = std::move( m_items[head] );
+			m_head.store( (head + 1) % m_items.size( ), std::memory_order_release );
+			return true;
+		}
+
+		void push( T value ) {
+			while( !try_push( value ) ) {
+				std::this_thread::yield( );
+			}
+		}
+
+		// Waits for a value.  Returns false once the queue is closed and drained
+		bool pop( T & value ) {
+			while( !try_pop( value ) ) {
+				if( m_closed.load( std::memory_order_acquire ) ) {
+					// a push may have landed between the failed pop and seeing closed
+					return try_pop( value );
+				}
+				std::this_thread::yield( );
+			}
+			return true;
+		}
+
+		// Called by the producer after its last push
+		void close( ) {
+			m_closed.store( true, std::memory_order_release );
+		}
+
+		~spsc_queue( ) = default;
+		spsc_queue( spsc_queue const & ) = delete;
+		spsc_queue( spsc_queue && ) = delete;
+		spsc_queue & operator=( spsc_queue const & ) = delete;
+		spsc_queue & operator=( spsc_queue && ) = delete;
+	};	// spsc_queue
+}	// namespace daw
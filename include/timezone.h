@@ -0,0 +1,75 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace daw {
+	namespace history {
+		struct zone_transition_t {
+			int64_t utc;	// seconds since the epoch the offset starts at
+			int32_t offset;	// seconds east of UTC
+		};	// zone_transition_t
+
+		// The UTC offsets of one zone over a span of years.  Pump clocks keep local time, so
+		// converting a record to UTC needs the offset that was in force at that local time.
+		// Offsets are kept by the local time they start at, the clock reading just before the
+		// change.  A repeated hour after clocks go back maps to its first pass and an hour
+		// skipped when they go forward maps with the new offset
+		class timezone_table {
+			std::string m_name;
+			std::vector<int64_t> m_local_starts;	// sorted, the first is the lowest int64_t
+			std::vector<int32_t> m_offsets;
+			mutable std::atomic<size_t> m_last;	// last period found, in order times start there
+
+			bool covers( size_t period, int64_t local_seconds ) const;
+			size_t find( int64_t local_seconds ) const;
+		public:
+			timezone_table( std::string name, int32_t initial_offset, std::vector<zone_transition_t> const & transitions );
+			timezone_table( timezone_table const & ) = delete;
+			timezone_table & operator=( timezone_table const & ) = delete;
+
+			std::string const & name( ) const;
+			size_t transitions( ) const;
+			// Seconds east of UTC at a local time in seconds since the epoch.  One step from the
+			// last lookup when times arrive in order, a binary search otherwise
+			int32_t offset_at_local( int64_t local_seconds ) const;
+			int64_t to_utc( int64_t local_seconds ) const;
+		};	// timezone_table
+
+		// The transitions of name between the start of first_year and the end of last_year.  name
+		// is a tzdata zone such as America/Toronto, read from $TZDIR or /usr/share/zoneinfo, or a
+		// POSIX TZ string such as EST5EDT,M3.2.0,M11.1.0.  Years past the zone file's table follow
+		// its TZ string.  Throws std::runtime_error when name is neither
+		std::shared_ptr<timezone_table const> load_timezone( std::string const & name, uint16_t first_year, uint16_t last_year );
+		// load_timezone over the years a pump clock can be set to, 2000 to the year after this one
+		std::shared_ptr<timezone_table const> load_pump_timezone( std::string const & name );
+
+		// Offset of zone at a local time, the offset this process is running at when zone is nullptr
+		int32_t utc_offset_at_local( timezone_table const * zone, int64_t local_seconds );
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,61 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace daw {
+	namespace trace {
+		// Tracing is off until enabled and then costs one relaxed load per span.  Events go
+		// into a buffer owned by the recording thread, so recording never takes a lock
+		bool enabled( ) noexcept;
+		void enable( );
+
+		// Shown as the thread's name in the trace
+		void set_thread_name( char const * name );
+
+		// Names and categories must outlive the trace, they are stored as pointers
+		class scoped_span {
+			char const * m_name;
+			char const * m_category;
+			char const * m_arg_name;
+			int64_t m_arg_value;
+			int64_t m_start;
+			bool m_active;
+		public:
+			explicit scoped_span( char const * name, char const * category = "decode" );
+			scoped_span( char const * name, char const * category, char const * arg_name, int64_t arg_value );
+			~scoped_span( );
+
+			scoped_span( scoped_span const & ) = delete;
+			scoped_span & operator=( scoped_span const & ) = delete;
+		};	// scoped_span
+
+		void counter( char const * name, int64_t value );
+
+		// Writes everything recorded as Chrome trace event JSON, which Perfetto and
+		// chrome://tracing open.  Call after the traced threads have finished
+		bool write_chrome_trace( std::string const & file_name );
+	}	// namespace trace
+}	// namespace daw
@@ -0,0 +1,277 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "history_decode.h"
+#include "history_pages.h"
+#include "insulin_on_board.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			// oref0's exponential insulin curve, fraction remaining t minutes after a dose
+			double exponential_remaining( double t, double td, double tp ) {
+				if( t <= 0.0 ) {
+					return 1.0;
+				}
+				if( t >= td ) {
+					return 0.0;
+				}
+				auto const tau = tp*(1.0 - tp/td)/(1.0 - 2.0*tp/td);
+				auto const a = 2.0*tau/td;
+				auto const S = 1.0/(1.0 - a + (1.0 + a)*std::exp( -td/tau ));
+				return 1.0 - S*(1.0 - a)*((t*t/(tau*td*(1.0 - a)) - t/tau - 1.0)*std::exp( -t/tau ) + 1.0);
+			}
+
+			size_t grid_size( int64_t start, int64_t end ) {
+				if( end < start ) {
+					return 0;
+				}
+				return static_cast<size_t>((end - start)/iob_step_seconds) + 1;
+			}
+
+			// Doses on the grid.  A dose between two steps is put on the later one, with the part
+			// of a step it was given before that in early.  Convolving whole with the table and
+			// early with the table one step on is the same as evaluating each dose at its exact
+			// age, as the table is linear between steps
+			struct dose_buckets_t {
+				std::vector<double> whole;
+				std::vector<double> early;
+
+				explicit dose_buckets_t( size_t count ):
+					whole( count, 0.0 ),
+					early( count, 0.0 ) { }
+			};	// dose_buckets_t
+
+			template<typename Func>
+			void for_each_delivery( std::vector<insulin_dose_t> const & doses, Func func ) {
+				for( auto const & dose : doses ) {
+					if( dose.duration_minutes == 0 ) {
+						func( dose.epoch, dose.amount );
+						continue;
+					}
+					// Extended boluses as even parts every step of their duration
+					auto const parts = std::max<int64_t>( 1, static_cast<int64_t>(dose.duration_minutes)*60/iob_step_seconds );
+					auto const amount = dose.amount/static_cast<double>(parts);
+					for( int64_t n = 0; n < parts; ++n ) {
+						func( dose.epoch + n*iob_step_seconds, amount );
+					}
+				}
+			}
+
+			// bucket 0 is at first
+			dose_buckets_t bucket_doses( std::vector<insulin_dose_t> const & doses, int64_t first, size_t count ) {
+				dose_buckets_t buckets{ count };
+				for_each_delivery( doses, [&]( int64_t epoch, double amount ) {
+					if( epoch <= first - iob_step_seconds ) {
+						return;
+					}
+					auto const since = epoch - first;
+					auto const n = static_cast<size_t>((since + iob_step_seconds - 1)/iob_step_seconds);
+					if( n >= count ) {
+						return;
+					}
+					auto const early = static_cast<double>(static_cast<int64_t>(n)*iob_step_seconds - since)/static_cast<double>(iob_step_seconds);
+					buckets.whole[n] += amount*(1.0 - early);
+					buckets.early[n] += amount*early;
+				} );
+				return buckets;
+			}
+		}	// namespace anonymous
+
+		insulin_curve_t::insulin_curve_t( ):
+			dia_minutes{ 300 },
+			peak_minutes{ 75 } { }
+
+		insulin_curve_t::insulin_curve_t( uint32_t dia, uint32_t peak ):
+			dia_minutes{ dia },
+			peak_minutes{ peak } { }
+
+		bool insulin_curve_t::valid( ) const {
+			return peak_minutes > 0 && dia_minutes > 2*peak_minutes;
+		}
+
+		iob_curve_table::iob_curve_table( insulin_curve_t curve ):
+			m_curve{ std::move( curve ) },
+			m_remaining{ } {
+
+			if( !m_curve.valid( ) ) {
+				throw std::invalid_argument( "The insulin peak must be after 0 minutes and less than half the duration of insulin action" );
+			}
+			auto const td = static_cast<double>(m_curve.dia_minutes);
+			auto const tp = static_cast<double>(m_curve.peak_minutes);
+			auto const steps = m_curve.dia_minutes*60/iob_step_seconds + 1;
+			m_remaining.reserve( static_cast<size_t>(steps) );
+			for( int64_t n = 0; n < steps; ++n ) {
+				m_remaining.push_back( exponential_remaining( static_cast<double>(n*iob_step_seconds)/60.0, td, tp ) );
+			}
+		}
+
+		double iob_curve_table::remaining( double minutes ) const {
+			if( minutes <= 0.0 ) {
+				return 1.0;
+			}
+			auto const position = minutes*60.0/static_cast<double>(iob_step_seconds);
+			auto const n = static_cast<size_t>(position);
+			if( n + 1 >= m_remaining.size( ) ) {
+				return 0.0;
+			}
+			auto const fraction = position - static_cast<double>(n);
+			return m_remaining[n] + (m_remaining[n + 1] - m_remaining[n])*fraction;
+		}
+
+		std::vector<double> const & iob_curve_table::steps( ) const {
+			return m_remaining;
+		}
+
+		insulin_curve_t const & iob_curve_table::curve( ) const {
+			return m_curve;
+		}
+
+		insulin_history_collector::insulin_history_collector( ):
+			m_history{ { }, { }, no_timestamp },
+			m_has_pending_total{ false },
+			m_pending_total{ 0.0 } { }
+
+		void insulin_history_collector::add( history_entry_obj const & entry ) {
+			if( auto const unabsorbed = dynamic_cast<hist_unabsorbed_insulin const *>( &entry ) ) {
+				double total = 0.0;
+				for( auto const & record : unabsorbed->m_records ) {
+					total += record.m_amount;
+				}
+				m_has_pending_total = true;
+				m_pending_total = total;
+				return;
+			}
+			auto const ts = entry.timestamp( );
+			if( !ts ) {
+				return;
+			}
+			auto const epoch = to_epoch_seconds( *ts );
+			m_history.latest = std::max( m_history.latest, epoch );
+			if( m_has_pending_total ) {
+				m_history.references.push_back( iob_reference_t{ epoch, m_pending_total } );
+				m_has_pending_total = false;
+			}
+			if( auto const bolus = dynamic_cast<hist_bolus_normal const *>( &entry ) ) {
+				// Smaller pumps always report 0, so only a non zero total says anything
+				if( bolus->m_unabsorbed_insulin_total > 0.0 ) {
+					m_history.references.push_back( iob_reference_t{ epoch, bolus->m_unabsorbed_insulin_total } );
+				}
+				if( bolus->m_amount > 0.0 ) {
+					m_history.doses.push_back( insulin_dose_t{ epoch, bolus->m_amount, bolus->m_duration } );
+				}
+			}
+		}
+
+		insulin_history_t insulin_history_collector::take( ) {
+			auto result = std::move( m_history );
+			m_history = insulin_history_t{ { }, { }, no_timestamp };
+			m_has_pending_total = false;
+			auto const by_time = []( auto const & lhs, auto const & rhs ) {
+				return lhs.epoch < rhs.epoch;
+			};
+			std::stable_sort( result.doses.begin( ), result.doses.end( ), by_time );
+			std::stable_sort( result.references.begin( ), result.references.end( ), by_time );
+			return result;
+		}
+
+		insulin_history_t collect_insulin_history( std::vector<std::unique_ptr<history_entry_obj>> const & entries ) {
+			insulin_history_collector collector;
+			for( auto const & entry : entries ) {
+				if( entry ) {
+					collector.add( *entry );
+				}
+			}
+			return collector.take( );
+		}
+
+		int64_t iob_series_t::epoch( size_t n ) const {
+			return start + static_cast<int64_t>(n)*iob_step_seconds;
+		}
+
+		double iob_series_t::at( int64_t when ) const {
+			if( iob.empty( ) || when < start ) {
+				return iob.empty( ) ? 0.0 : iob.front( );
+			}
+			auto const n = static_cast<size_t>((when - start)/iob_step_seconds);
+			return n < iob.size( ) ? iob[n] : iob.back( );
+		}
+
+		iob_series_t compute_iob( std::vector<insulin_dose_t> const & doses, int64_t start, int64_t end, iob_curve_table const & table ) {
+			iob_series_t result{ start, std::vector<double>( grid_size( start, end ), 0.0 ) };
+			auto const & curve = table.steps( );
+			auto const window = curve.size( );
+			// Doses up to one action duration before start are still on board at start
+			auto const lead = window - 1;
+			auto const first = start - static_cast<int64_t>(lead)*iob_step_seconds;
+			auto const buckets = bucket_doses( doses, first, lead + result.iob.size( ) );
+
+			for( size_t n = 0; n < result.iob.size( ); ++n ) {
+				auto const current = n + lead;	// the bucket at this step
+				double sum = buckets.whole[current]*curve[0];
+				for( size_t k = 1; k < window; ++k ) {
+					sum += buckets.whole[current - k]*curve[k] + buckets.early[current - k + 1]*curve[k];
+				}
+				result.iob[n] = sum;
+			}
+			return result;
+		}
+
+		iob_series_t compute_iob_naive( std::vector<insulin_dose_t> const & doses, int64_t start, int64_t end, iob_curve_table const & table ) {
+			iob_series_t result{ start, std::vector<double>( grid_size( start, end ), 0.0 ) };
+			for( size_t n = 0; n < result.iob.size( ); ++n ) {
+				auto const now = result.epoch( n );
+				double sum = 0.0;
+				for_each_delivery( doses, [&]( int64_t epoch, double amount ) {
+					if( epoch <= now ) {
+						sum += amount*table.remaining( static_cast<double>(now - epoch)/60.0 );
+					}
+				} );
+				result.iob[n] = sum;
+			}
+			return result;
+		}
+
+		iob_validation_t validate_iob( iob_series_t const & series, std::vector<iob_reference_t> const & references ) {
+			iob_validation_t result{ 0, 0.0, 0.0 };
+			double total = 0.0;
+			for( auto const & reference : references ) {
+				// The step before, so a bolus given at the reference is not counted
+				auto const when = reference.epoch - iob_step_seconds;
+				if( series.iob.empty( ) || when < series.start || when > series.epoch( series.iob.size( ) - 1 ) ) {
+					continue;
+				}
+				auto const error = std::abs( series.at( when ) - reference.reported );
+				total += error;
+				result.max_abs_error = std::max( result.max_abs_error, error );
+				++result.compared;
+			}
+			if( result.compared > 0 ) {
+				result.mean_abs_error = total/static_cast<double>(result.compared);
+			}
+			return result;
+		}
+	}	// namespace history
+}	// namespace daw
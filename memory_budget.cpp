@@ -0,0 +1,158 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <cctype>
+#include <cstdlib>
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+#include "memory_budget.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			void update_peak( std::atomic<size_t> & peak, size_t value ) {
+				auto current = peak.load( std::memory_order_relaxed );
+				while( value > current && !peak.compare_exchange_weak( current, value, std::memory_order_relaxed ) ) { }
+			}
+		}	// namespace anonymous
+
+		memory_budget::stage_t::stage_t( std::string stage_name ):
+			name{ std::move( stage_name ) },
+			used{ 0 },
+			peak{ 0 } { }
+
+		memory_budget::memory_budget( size_t limit ):
+			m_limit{ limit },
+			m_used{ 0 },
+			m_peak{ 0 },
+			m_stages{ },
+			m_mutex{ },
+			m_released{ } { }
+
+		memory_budget::~memory_budget( ) { }
+
+		size_t memory_budget::add_stage( std::string name ) {
+			m_stages.push_back( std::make_unique<stage_t>( std::move( name ) ) );
+			return m_stages.size( ) - 1;
+		}
+
+		void memory_budget::account( size_t stage, size_t bytes ) {
+			auto & s = *m_stages[stage];
+			update_peak( s.peak, s.used.fetch_add( bytes ) + bytes );
+		}
+
+		bool memory_budget::try_reserve( size_t stage, size_t bytes ) {
+			auto current = m_used.load( );
+			do {
+				if( m_limit != 0 && current + bytes > m_limit ) {
+					return false;
+				}
+			} while( !m_used.compare_exchange_weak( current, current + bytes ) );
+			update_peak( m_peak, current + bytes );
+			account( stage, bytes );
+			return true;
+		}
+
+		void memory_budget::reserve( size_t stage, size_t bytes ) {
+			if( try_reserve( stage, bytes ) ) {
+				return;
+			}
+			std::unique_lock<std::mutex> lock( m_mutex );
+			bool reserved = false;
+			m_released.wait( lock, [&]( ) {
+				reserved = try_reserve( stage, bytes );
+				return reserved || (bytes > m_limit && m_used.load( ) == 0);
+			} );
+			if( !reserved ) {
+				force_reserve( stage, bytes );
+			}
+		}
+
+		void memory_budget::force_reserve( size_t stage, size_t bytes ) {
+			update_peak( m_peak, m_used.fetch_add( bytes ) + bytes );
+			account( stage, bytes );
+		}
+
+		void memory_budget::release( size_t stage, size_t bytes ) {
+			m_stages[stage]->used.fetch_sub( bytes );
+			m_used.fetch_sub( bytes );
+			if( m_limit != 0 ) {
+				// Taking the lock orders this with a waiter checking the condition
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_released.notify_all( );
+			}
+		}
+
+		size_t memory_budget::limit( ) const {
+			return m_limit;
+		}
+
+		size_t memory_budget::used( ) const {
+			return m_used.load( );
+		}
+
+		size_t memory_budget::peak( ) const {
+			return m_peak.load( );
+		}
+
+		std::vector<memory_stage_usage_t> memory_budget::usage( ) const {
+			std::vector<memory_stage_usage_t> result;
+			result.reserve( m_stages.size( ) );
+			for( auto const & stage : m_stages ) {
+				result.push_back( memory_stage_usage_t{ stage->name, stage->used.load( ), stage->peak.load( ) } );
+			}
+			return result;
+		}
+
+		size_t parse_memory_size( std::string const & text ) {
+			char * last = nullptr;
+			auto const value = std::strtoull( text.c_str( ), &last, 10 );
+			if( last == text.c_str( ) ) {
+				return 0;
+			}
+			switch( std::toupper( static_cast<unsigned char>(*last) ) ) {
+			case 0: return static_cast<size_t>(value);
+			case 'K': return static_cast<size_t>(value) << 10;
+			case 'M': return static_cast<size_t>(value) << 20;
+			case 'G': return static_cast<size_t>(value) << 30;
+			default: return 0;
+			}
+		}
+
+		size_t peak_resident_bytes( ) {
+#ifdef WIN32
+			return 0;
+#else
+			struct rusage usage = { };
+			if( getrusage( RUSAGE_SELF, &usage ) != 0 ) {
+				return 0;
+			}
+#ifdef __APPLE__
+			return static_cast<size_t>(usage.ru_maxrss);
+#else
+			return static_cast<size_t>(usage.ru_maxrss)*1024;
+#endif
+#endif
+		}
+	}	// namespace history
+}	// namespace daw
@@ -20,12 +20,33 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "decode_pipeline.h"
+#include "history_decode.h"
+#include "history_input.h"
+#include "history_merge.h"
 #include "history_pages.h"
+#include "history_range.h"
+#include "history_store.h"
+#include "insulin_on_board.h"
+#include "memory_budget.h"
+#include "opcode_learning.h"
+#include "page_cache.h"
+#include "parallel_framing.h"
+#include "pump_state.h"
+#include "pump_model_detect.h"
+#include "sensor_pages.h"
+#include "settings_history.h"
+#include "timezone.h"
+#include "trace.h"
 #include <iostream>
 #include <streambuf>
 #include <fstream>
 #include <cstdlib>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
 
 template<typename Data>
 void display( Data const & data ) {
@@ -41,98 +62,773 @@ auto current_year( ) {
 	return boost::posix_time::second_clock::local_time( ).date( ).year( );
 }
 
-std::string read_file( std::string file_name ) {
-	std::ifstream ifs( file_name.c_str( ) );
-	std::string result;
+// Pages of a hex or binary history file, compressed or not, without their CRCs
+std::vector<uint8_t> read_history_bytes( std::string const & file_name ) {
+	daw::trace::scoped_span const span{ "read_history_bytes", "input" };
+	daw::history::history_input_file input{ file_name };
+	daw::history::history_page_reader reader{ input.stream( ) };
 
-	ifs.seekg( 0, std::ios::end );
-	result.reserve( static_cast<size_t>(ifs.tellg( )) );
-	ifs.seekg( 0, std::ios::beg );
+	std::vector<uint8_t> v;
+	std::vector<uint8_t> page;
+	while( reader.next( page ) ) {
+		v.insert( v.end( ), page.begin( ), page.end( ) );
+	}
+	return v;
+}
 
-	result.assign( (std::istreambuf_iterator<char>( ifs )), std::istreambuf_iterator<char>( ) );
+int decode_sensor_file( std::string const & file_name, daw::history::timezone_table const * timezone ) {
+	daw::history::history_input_file input{ file_name };
+	if( !input.is_open( ) ) {
+		std::cerr << "ERROR: Could not open " << file_name << "\n";
+		return EXIT_FAILURE;
+	}
+	daw::history::history_page_reader reader{ input.stream( ) };
+	std::vector<uint8_t> v;
+	std::vector<uint8_t> page;
+	while( reader.next_raw( page ) ) {
+		v.insert( v.end( ), page.begin( ), page.end( ) );
+	}
+	auto const download = daw::history::decode_sensor_download( daw::range::make_range( v.data( ), v.data( ) + v.size( ) ), timezone );
+	for( size_t n = 0; n < download.pages.size( ); ++n ) {
+		if( download.pages[n].status == daw::history::page_status_t::crc_mismatch ) {
+			std::cerr << "WARNING: CRC mismatch on sensor page " << n << "\n";
+		}
+	}
+	for( auto const & error : download.errors ) {
+		std::cerr << "WARNING: Unknown sensor op_code on page " << error.page << " at " << error.offset << "\n";
+	}
+	std::cout << "epoch,mg_dl,flags\n";
+	for( auto const & reading : download.glucose ) {
+		if( reading.epoch != daw::history::no_timestamp ) {
+			std::cout << reading.epoch;
+		}
+		std::cout << "," << reading.mg_dl << "," << static_cast<int>(reading.flags) << "\n";
+	}
+	return EXIT_SUCCESS;
+}
 
-	return result;
+int learn_opcodes( boost::optional<daw::history::pump_model_t> const & claimed_model, std::vector<std::string> const & file_names, std::string const & overlay_file ) {
+	std::unique_ptr<daw::history::opcode_learner> learner;
+	for( auto const & file_name : file_names ) {
+		auto v = read_history_bytes( file_name );
+		auto const range = daw::range::make_range( v.data( ), v.data( ) + v.size( ) );
+		if( !learner ) {
+			learner = std::make_unique<daw::history::opcode_learner>( daw::history::resolve_pump_model( range, claimed_model ) );
+		}
+		learner->add_page( range );
+	}
+	if( !learner ) {
+		return EXIT_FAILURE;
+	}
+	auto const opcodes = learner->results( );
+	for( auto const & opcode : opcodes ) {
+		std::cerr << "Learned op_code " << std::hex << static_cast<int>(opcode.op_code) << std::dec << ": size=" << opcode.layout.size;
+		std::cerr << " timestamp_offset=" << opcode.layout.timestamp_offset << " occurrences=" << opcode.occurrences << " confidence=" << opcode.confidence << "\n";
+	}
+	if( !daw::history::save_opcode_overlay( overlay_file, opcodes ) ) {
+		std::cerr << "ERROR: Could not write " << overlay_file << "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
 }
 
-int main( int argc, char** argv ) {
-	assert( argc > 2 );
-	daw::history::pump_model_t pump_model( argv[1] );
-	
-	auto data = read_file( argv[2] );
+template<typename Func>
+auto time_it( std::chrono::microseconds & elapsed, Func func ) {
+	auto const start = std::chrono::steady_clock::now( );
+	auto result = func( );
+	elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now( ) - start );
+	return result;
+}
 
-	std::vector<uint8_t> v;
-	for( size_t n = 0; n < data.size( ); n += 2 ) {
-		while( std::isspace( data[n] ) ) {
-			++n;
-		}
-		char tmp[3] = { data[n], data[n + 1], 0 };
-		v.push_back( static_cast<uint8_t>(strtol( tmp, nullptr, 16 )) );
+void report_iob( daw::history::insulin_history_t const & history, daw::history::insulin_curve_t const & curve ) {
+	if( history.doses.empty( ) ) {
+		std::cerr << "WARNING: No boluses to compute insulin on board from\n";
+		return;
 	}
-	if( v.back( ) == 0 ) {
-		v.pop_back( ); // null terminator
+	auto const end = std::max( history.doses.back( ).epoch, history.latest );
+	daw::history::iob_curve_table const table{ curve };
+	std::chrono::microseconds elapsed;
+	auto const series = time_it( elapsed, [&]( ) {
+		return daw::history::compute_iob( history.doses, history.doses.front( ).epoch, end, table );
+	} );
+	std::cout << "epoch,iob\n";
+	for( size_t n = 0; n < series.iob.size( ); ++n ) {
+		std::cout << series.epoch( n ) << "," << series.iob[n] << "\n";
 	}
-	v.pop_back( ); // crc
-	v.pop_back( ); // crc
-	auto range = daw::range::make_range( v.data( ), v.data( ) + v.size( ) );
+	std::cerr << "IOB: " << history.doses.size( ) << " doses, " << series.iob.size( ) << " steps in " << elapsed.count( ) << "us\n";
+	auto const validation = daw::history::validate_iob( series, history.references );
+	std::cerr << "IOB: compared with " << validation.compared << " pump reported totals, mean error " << validation.mean_abs_error << "U, max error " << validation.max_abs_error << "U\n";
+}
 
-	std::vector<std::unique_ptr<daw::history::history_entry_obj>> entries;
-	size_t pos = 0;
+// A year of boluses every 4 hours, timing the table convolution against evaluating every dose
+int bench_iob( daw::history::insulin_curve_t const & curve ) {
+	int64_t const start = 1451606400;	// 2016-01-01
+	int64_t const end = start + 365*24*60*60;
+	std::vector<daw::history::insulin_dose_t> doses;
+	uint32_t seed = 1;
+	for( int64_t epoch = start; epoch < end; epoch += 4*60*60 ) {
+		seed = seed*1103515245u + 12345u;
+		auto const amount = 0.5 + static_cast<double>((seed >> 16) % 80)/10.0;
+		auto const duration = (seed >> 8) % 10 == 0 ? 120u : 0u;
+		doses.push_back( daw::history::insulin_dose_t{ epoch + static_cast<int64_t>((seed >> 4) % 3600), amount, duration } );
+	}
+	daw::history::iob_curve_table const table{ curve };
+	std::chrono::microseconds fast_time;
+	std::chrono::microseconds naive_time;
+	auto const fast = time_it( fast_time, [&]( ) { return daw::history::compute_iob( doses, start, end, table ); } );
+	auto const naive = time_it( naive_time, [&]( ) { return daw::history::compute_iob_naive( doses, start, end, table ); } );
+	double max_difference = 0.0;
+	for( size_t n = 0; n < fast.iob.size( ); ++n ) {
+		max_difference = std::max( max_difference, std::abs( fast.iob[n] - naive.iob[n] ) );
+	}
+	std::cout << doses.size( ) << " doses, " << fast.iob.size( ) << " steps\n";
+	std::cout << "table: " << fast_time.count( ) << "us\n";
+	std::cout << "per dose: " << naive_time.count( ) << "us\n";
+	std::cout << "largest difference: " << max_difference << "U\n";
+	return EXIT_SUCCESS;
+}
 
-	auto good_item = []( auto const & i ) {
-		if( !i ) {
+bool reasonible_year( daw::history::history_entry_obj const & item ) {
+	if( item.timestamp( ) ) {
+		auto item_year = item.timestamp( )->date( ).year( );
+		auto this_year = current_year( );
+		if( item_year < this_year - 2 ) {
 			return false;
 		}
-		if( !i->timestamp( ) ) {
+		if( item_year > this_year + 2 ) {
 			return false;
 		}
-		return i->timestamp( )->date( ).year( ) == current_year( );
+	}
+	return true;	// Not all items have timestamps
+}
+
+daw::history::pump_model_t get_pump_model( daw::history::data_source_t const & page, boost::optional<daw::history::pump_model_t> const & claimed_model, bool detect_model, std::shared_ptr<daw::history::timezone_table const> const & timezone ) {
+	if( !detect_model ) {
+		auto pump_model = *claimed_model;
+		pump_model.timezone = timezone;
+		return pump_model;
+	}
+	daw::history::pump_model_guess_t guess;
+	auto pump_model = daw::history::resolve_pump_model( page, claimed_model, &guess );
+	pump_model.timezone = timezone;
+	std::cerr << "Detected pump family: " << daw::history::to_string( guess.family ) << " (confidence " << guess.confidence << ")\n";
+	if( claimed_model && claimed_model->family( ) != guess.family ) {
+		std::cerr << "WARNING: The pump model given does not match the page contents\n";
+	}
+	return pump_model;
+}
+
+// Prints the records of several downloads from one pump oldest first, those in more than one
+// download once
+int merge_downloads( boost::optional<daw::history::pump_model_t> const & claimed_model, bool detect_model, std::shared_ptr<daw::history::timezone_table const> const & timezone, std::vector<std::string> const & file_names ) {
+	boost::optional<daw::history::pump_model_t> pump_model;
+	daw::history::history_merge merge;
+	for( auto const & file_name : file_names ) {
+		auto v = read_history_bytes( file_name );
+		auto const range = daw::range::make_range( v.data( ), v.data( ) + v.size( ) );
+		if( !pump_model ) {
+			pump_model = get_pump_model( range, claimed_model, detect_model, timezone );
+		}
+		merge.add_stream( daw::history::make_download_stream( range, *pump_model ) );
+	}
+	size_t records = 0;
+	while( auto item = merge.next( ) ) {
+		std::cout << item->encode( ) << "\n\n";
+		++records;
+	}
+	std::cerr << "merge: " << records << " records, " << merge.duplicates( ) << " duplicates dropped\n";
+	return EXIT_SUCCESS;
+}
+
+// A record kept for a report that wants them oldest first
+struct timed_record_t {
+	uint8_t op_code;
+	int64_t epoch;
+	std::vector<uint8_t> data;
+};	// timed_record_t
+
+struct decode_state_t {
+	boost::optional<daw::history::pump_model_t> pump_model;
+	std::shared_ptr<daw::history::timezone_table const> timezone;	// only with --tz
+	std::unique_ptr<daw::history::history_store_writer> store;
+	std::unique_ptr<daw::history::history_record_table_t> store_records;	// the download, appended to store in one batch
+	std::unique_ptr<daw::history::pump_state_history> stored_state;	// of the records in store
+	std::unique_ptr<daw::history::insulin_history_collector> iob;	// only with --iob
+	std::unique_ptr<std::vector<timed_record_t>> settings;	// only with --settings-at or --settings-changes
+	std::unique_ptr<std::vector<timed_record_t>> pump_state;	// only with --state-at
+	size_t out_of_order = 0;
+	int64_t resync_bytes = 0;
+	uint32_t page = 0;	// of the start of the buffer being decoded
+};	// decode_state_t
+
+void add_store_record( daw::history::history_record_table_t & table, uint32_t page, uint32_t offset, daw::history::history_entry_obj const & entry ) {
+	auto const ts = entry.timestamp( );
+	table.op_codes.push_back( entry.op_code( ) );
+	table.timestamps.push_back( ts ? daw::history::to_epoch_seconds( *ts ) : daw::history::no_timestamp );
+	table.pages.push_back( page );
+	table.offsets.push_back( offset );
+	table.sizes.push_back( static_cast<uint32_t>(entry.data( ).size( )) );
+	table.data_offsets.push_back( static_cast<uint32_t>(table.data.size( )) );
+	table.data.insert( table.data.end( ), entry.data( ).begin( ), entry.data( ).end( ) );
+}
+
+// Appends the records decoded to the store in one sorted batch, as the pages of a download
+// are newest first, and updates the stored pump state with those that were new
+void store_download( decode_state_t & state ) {
+	auto const & records = *state.store_records;
+	auto const appended = state.store->append( records );
+	state.out_of_order += appended.out_of_order;
+	for( auto n : appended.records ) {
+		if( records.timestamps[n] == daw::history::no_timestamp ) {
+			continue;
+		}
+		auto const first = records.data.begin( ) + records.data_offsets[n];
+		state.stored_state->add( records.op_codes[n], records.timestamps[n], std::vector<uint8_t>( first, first + records.sizes[n] ) );
+	}
+}
+
+// Appends the output for one record to out.  The decoded entry is not kept
+void decode_record( daw::history::history_record_view const & rec, size_t buffer_size, decode_state_t & state, std::string & out ) {
+	if( rec.is_error( ) ) {
+		state.resync_bytes += static_cast<int64_t>(rec.size( ));
+		daw::trace::counter( "resync_bytes", state.resync_bytes );
+		out += std::to_string( rec.offset( )+1 ) + "/" + std::to_string( buffer_size ) + ": ";
+		out += "ERROR: data( " + std::to_string( rec.size( ) ) + " ) { ";
+		out += rec.data( ).to_hex_string( ) + " }\n\n";
+		return;
+	}
+	auto item = rec.decode( );
+	assert( item );
+	if( state.store_records ) {
+		auto const page_body = daw::history::history_page_size - 2;
+		add_store_record( *state.store_records, state.page + static_cast<uint32_t>(rec.offset( )/page_body), static_cast<uint32_t>(rec.offset( )%page_body), *item );
+	}
+	if( state.iob ) {
+		state.iob->add( *item );
+		return;
+	}
+	if( state.settings ) {
+		auto const ts = item->timestamp( );
+		if( ts && daw::history::is_settings_op_code( item->op_code( ) ) ) {
+			state.settings->push_back( timed_record_t{ item->op_code( ), daw::history::to_epoch_seconds( *ts ), item->data( ) } );
+		}
+		return;
+	}
+	if( state.pump_state ) {
+		auto const ts = item->timestamp( );
+		if( ts && daw::history::is_pump_state_op_code( item->op_code( ) ) ) {
+			state.pump_state->push_back( timed_record_t{ item->op_code( ), daw::history::to_epoch_seconds( *ts ), item->data( ) } );
+		}
+		return;
+	}
+	if( !reasonible_year( *item ) ) {
+		std::cerr << "WARNING: The year does not look correct, outside of plus or minute 2 years from current system year\n";
+	}
+	daw::trace::scoped_span const span{ "encode", "decode", "op_code", item->op_code( ) };
+	out += std::to_string( rec.offset( )+rec.size( )+1 ) + "/" + std::to_string( buffer_size ) + ": ";
+	out += item->encode( ) + "\n\n";
+}
+
+// Traces a span per page of a buffer of pages without their CRCs, covering the records that
+// start in it, so slow pages show up in traces of whole file decodes
+class page_spans {
+	size_t m_page;
+	std::unique_ptr<daw::trace::scoped_span> m_span;
+public:
+	page_spans( ):
+		m_page{ std::numeric_limits<size_t>::max( ) },
+		m_span{ } { }
+
+	void at( size_t offset ) {
+		if( !daw::trace::enabled( ) ) {
+			return;
+		}
+		auto const page = offset/(daw::history::history_page_size - 2);
+		if( page != m_page ) {
+			m_span.reset( );
+			m_span = std::make_unique<daw::trace::scoped_span>( "page", "page", "page", static_cast<int64_t>(page) );
+			m_page = page;
+		}
+	}
+};	// page_spans
+
+// Decodes a page at a time, holding completed output until the budget is reached and then
+// writing it out.  Offsets are within each page
+void decode_within_budget( std::string const & file_name, boost::optional<daw::history::pump_model_t> const & claimed_model, bool detect_model, decode_state_t & state, daw::history::memory_budget & budget ) {
+	auto const input_stage = budget.add_stage( "input" );
+	auto const page_stage = budget.add_stage( "pages" );
+	auto const output_stage = budget.add_stage( "output" );
+
+	// Smaller reads for small budgets, this is most of the fixed cost
+	auto const buffer_size = std::max<size_t>( 4*1024, std::min<size_t>( 64*1024, budget.limit( )/8 ) );
+	daw::history::history_input_file input{ file_name, buffer_size };
+	daw::history::history_page_reader reader{ input.stream( ), buffer_size };
+	// The file buffer, decompression buffer, read buffer and pending pages
+	budget.force_reserve( input_stage, 4*buffer_size );
+
+	std::string out;
+	auto const flush = [&]( ) {
+		daw::trace::scoped_span const span{ "output", "output" };
+		std::cout << out;
+		std::cout.flush( );
+		budget.release( output_stage, out.size( ) );
+		out.clear( );
 	};
 
-	auto reasonible_year = []( auto const & i ) {
-		if( i->timestamp( ) ) {
-			auto item_year = i->timestamp( )->date( ).year( );
-			auto this_year = current_year( );
-			if( item_year < this_year - 2 ) {
-				return false;
+	auto & pump_model = state.pump_model;
+	std::vector<uint8_t> page;
+	std::string record;
+	int64_t page_index = 0;
+	while( true ) {
+		// Make room for the next page by writing out what is done
+		while( !budget.try_reserve( page_stage, daw::history::history_page_size ) ) {
+			if( out.empty( ) ) {
+				budget.force_reserve( page_stage, daw::history::history_page_size );
+				break;
 			}
-			if( item_year > this_year + 2 ) {
-				return false;
+			flush( );
+		}
+		if( !reader.next( page ) ) {
+			budget.release( page_stage, daw::history::history_page_size );
+			break;
+		}
+		state.page = static_cast<uint32_t>(page_index);
+		daw::trace::scoped_span const span{ "page", "page", "page", page_index++ };
+		auto const range = daw::range::make_range( page.data( ), page.data( ) + page.size( ) );
+		if( !pump_model ) {
+			pump_model = get_pump_model( range, claimed_model, detect_model, state.timezone );
+		}
+		for( auto && rec : daw::history::decode( range, *pump_model ) ) {
+			record.clear( );
+			decode_record( rec, page.size( ), state, record );
+			if( !budget.try_reserve( output_stage, record.size( ) ) ) {
+				flush( );
+				budget.force_reserve( output_stage, record.size( ) );
 			}
+			out += record;
+		}
+		budget.release( page_stage, daw::history::history_page_size );
+	}
+	flush( );
+	budget.release( input_stage, 4*buffer_size );
+}
+
+// Frames the buffer with frame_history_parallel and decodes slices of the frames on jobs
+// threads.  Each slice is encoded into its own string and written in order, so the output
+// matches the serial decoder
+void decode_parallel( std::vector<uint8_t> & buffer, daw::history::pump_model_t const & pump_model, size_t jobs, decode_state_t & state ) {
+	auto const range = daw::history::decode( daw::range::make_range( buffer.data( ), buffer.data( ) + buffer.size( ) ), pump_model );
+	daw::history::parallel_framing_options_t options;
+	options.threads = jobs;
+	daw::history::parallel_framing_stats_t stats;
+	auto const frames = daw::history::frame_history_parallel( range.page( ), daw::history::history_framer{ pump_model }, options, &stats );
+	std::cerr << "framing: " << stats.chunks << " chunks, " << stats.stitched << " stitched, " << stats.reframed_bytes << " bytes reframed\n";
+
+	auto const slice_count = std::max<size_t>( 1, std::min( frames.size( ), jobs*4 ) );
+	auto const slice_size = frames.size( )/slice_count + 1;
+	std::vector<std::string> outputs( slice_count );
+	std::vector<int64_t> resync_bytes( slice_count, 0 );
+	std::atomic<size_t> next_slice{ 0 };
+	auto const worker = [&]( ) {
+		for( auto n = next_slice++; n < slice_count; n = next_slice++ ) {
+			decode_state_t slice_state;
+			page_spans spans;
+			auto const last = std::min( frames.size( ), (n + 1)*slice_size );
+			for( auto m = n*slice_size; m < last; ++m ) {
+				spans.at( frames[m].offset );
+				decode_record( daw::history::history_record_view{ &range, frames[m] }, buffer.size( ), slice_state, outputs[n] );
+			}
+			resync_bytes[n] = slice_state.resync_bytes;
 		}
-		return true;	// Not all items have timestamps
 	};
+	std::vector<std::thread> workers;
+	for( size_t n = 1; n < std::min( jobs, slice_count ); ++n ) {
+		workers.emplace_back( worker );
+	}
+	worker( );
+	for( auto & t : workers ) {
+		t.join( );
+	}
+	for( size_t n = 0; n < slice_count; ++n ) {
+		std::cout << outputs[n];
+		state.resync_bytes += resync_bytes[n];
+	}
+}
+
+void report_memory( daw::history::memory_budget const & budget ) {
+	for( auto const & stage : budget.usage( ) ) {
+		std::cerr << "memory: " << stage.name << " peak " << stage.peak << " bytes\n";
+	}
+	std::cerr << "memory: total peak " << budget.peak( ) << " of " << budget.limit( ) << " bytes, resident peak " << daw::history::peak_resident_bytes( ) << " bytes\n";
+}
+
+// Writes the trace on the way out of main, whichever way that is
+struct trace_file_t {
+	boost::optional<std::string> file_name;
+
+	~trace_file_t( ) {
+		if( file_name && !daw::trace::write_chrome_trace( *file_name ) ) {
+			std::cerr << "ERROR: Could not write trace " << *file_name << "\n";
+		}
+	}
+};	// trace_file_t
 
-	while( !range.at_end( ) ) {
-		auto item = daw::history::create_history_entry( range, pump_model, pos );
+// Prints the settings in effect at epoch, as rebuilt from the delta encoded history
+daw::history::settings_history make_settings_history( std::vector<timed_record_t> records, daw::history::pump_model_t const & pump_model ) {
+	// Pages are not always in time order, the history wants the records oldest first
+	std::stable_sort( records.begin( ), records.end( ), []( timed_record_t const & a, timed_record_t const & b ) {
+		return a.epoch < b.epoch;
+	} );
+	daw::history::settings_history history{ pump_model };
+	for( auto const & record : records ) {
+		history.add( record.op_code, record.epoch, record.data );
+	}
+	return history;
+}
+
+void show_settings_stats( daw::history::settings_history const & history ) {
+	auto const & stats = history.stats( );
+	std::cerr << "settings: " << stats.records << " records, " << stats.unchanged << " unchanged, " << stats.record_bytes << " bytes stored in " << stats.stored_bytes << "\n";
+}
+
+void report_settings( daw::history::settings_history const & history, int64_t epoch ) {
+	for( auto const op_code : history.op_codes( ) ) {
+		auto const entry = history.at( op_code, epoch );
+		if( entry ) {
+			std::cout << entry->encode( ) << "\n\n";
+		}
+	}
+	show_settings_stats( history );
+}
 
-		if( item ) {
-			if( item->op_code( ) == 0x0 ) {
+// Prints the settings changes as they are kept, a line per whole record checkpoint or run of
+// bytes that differ from the previous change
+void report_settings_changes( daw::history::settings_history const & history ) {
+	auto const show_bytes = []( std::vector<uint8_t> const & bytes ) {
+		std::cout << std::hex << std::setfill( '0' );
+		for( auto const b : bytes ) {
+			std::cout << std::setw( 2 ) << static_cast<int>(b);
+		}
+		std::cout << std::dec << "\n";
+	};
+	std::cout << "op_code,epoch,kind,offset,bytes\n";
+	for( auto const op_code : history.op_codes( ) ) {
+		for( auto const & change : history.changes( op_code ) ) {
+			if( !change.checkpoint.empty( ) ) {
+				std::cout << static_cast<int>(op_code) << "," << change.epoch << ",checkpoint,0,";
+				show_bytes( change.checkpoint );
 				continue;
 			}
-			std::cout << std::dec << std::dec << pos+1 << "/" << v.size( ) << ": ";
-			if( !reasonible_year( item ) ) {
-				std::cerr << "WARNING: The year does not look correct, outside of plus or minute 2 years from current system year\n";
+			for( auto const & run : change.runs ) {
+				std::cout << static_cast<int>(op_code) << "," << change.epoch << ",delta," << run.offset << ",";
+				show_bytes( run.bytes );
 			}
-			std::cout << item->encode( );
-			entries.push_back( std::move( item ) );
-		} else {
-			std::cout << std::dec << std::dec << pos+1 << "/" << v.size( ) << ": ";
-			std::cout << "ERROR: data( ";
-			auto err_start = pos;
-			safe_advance( range, 1 );
-			while( !range.at_end( ) && (range[0] == 0 || !(item = daw::history::create_history_entry( range, pump_model, pos )) || !good_item( item ) )) {
-				safe_advance( range, 1 );
-				++pos;
+		}
+	}
+	show_settings_stats( history );
+}
+
+// Prints what the pump was doing at epoch, replayed from the nearest state checkpoint
+void report_pump_state( daw::history::pump_state_history const & history, int64_t epoch ) {
+	auto const state = history.at( epoch );
+	auto const show_time = []( char const * name, int64_t value ) {
+		std::cout << name << ": ";
+		if( value != daw::history::no_timestamp ) {
+			std::cout << value;
+		}
+		std::cout << "\n";
+	};
+	show_time( "last_record", state.epoch );
+	std::cout << "suspended: " << (state.suspended( ) ? "yes" : "no") << "\n";
+	show_time( "suspended_since", state.suspended_since );
+	std::cout << "basal_profile: " << static_cast<int>(state.basal_profile) << "\n";
+	std::cout << "basal_rate: " << static_cast<double>(state.basal_rate)/40.0 << "\n";
+	std::cout << "temp_basal_type: " << (state.temp_basal_type_percent ? "percent" : "absolute") << "\n";
+	if( state.temp_basal_running( ) ) {
+		std::cout << "temp_basal: " << (state.temp_basal_percent ? static_cast<double>(state.temp_basal_rate) : static_cast<double>(state.temp_basal_rate)/40.0);
+		std::cout << (state.temp_basal_percent ? " percent" : " absolute") << " until " << state.temp_basal_end << "\n";
+	} else {
+		std::cout << "temp_basal: none\n";
+	}
+	std::cout << "time_format: " << (state.time_format_24hr ? "24hr" : "am_pm") << "\n";
+	show_time( "last_rewind", state.last_rewind );
+	show_time( "last_prime", state.last_prime );
+	show_time( "last_battery_change", state.last_battery_change );
+	auto const & stats = history.stats( );
+	std::cerr << "pump state: " << stats.records << " records, " << stats.events << " events, " << stats.checkpoints << " checkpoints\n";
+}
+
+void report_pump_state( std::vector<timed_record_t> records, int64_t epoch ) {
+	std::stable_sort( records.begin( ), records.end( ), []( timed_record_t const & a, timed_record_t const & b ) {
+		return a.epoch < b.epoch;
+	} );
+	daw::history::pump_state_history history;
+	for( auto const & record : records ) {
+		history.add( record.op_code, record.epoch, record.data );
+	}
+	report_pump_state( history, epoch );
+}
+
+// Whole minutes, 0 when text is not a number
+uint32_t parse_minutes( char const * text ) {
+	char * end = nullptr;
+	auto const result = std::strtoul( text, &end, 10 );
+	if( end == text || *end != '\0' || result > std::numeric_limits<uint32_t>::max( ) ) {
+		return 0;
+	}
+	return static_cast<uint32_t>(result);
+}
+
+void show_usage( char const * name ) {
+	std::cerr << "Usage: " << name << " [--tz <zone>] [--trace <trace file>] [--jobs <threads>] [--memory-budget <bytes>[K|M|G]] [--detect-model] [--store <store path>] [--opcode-overlay <overlay file>] <pump model|auto> <history file>\n";
+	std::cerr << "       " << name << " --pipeline [--trace <trace file>] [--memory-budget <bytes>[K|M|G]] [--page-cache <cache file>] [--opcode-overlay <overlay file>] <pump model> <history file>\n";
+	std::cerr << "       " << name << " --iob [--dia <minutes>] [--peak <minutes>] <pump model|auto> <history file>\n";
+	std::cerr << "       " << name << " --settings-at <epoch seconds> <pump model|auto> <history file>\n";
+	std::cerr << "       " << name << " --settings-changes <pump model|auto> <history file>\n";
+	std::cerr << "       " << name << " --state-at <epoch seconds> [--store <store path>] <pump model|auto> <history file>\n";
+	std::cerr << "       " << name << " --state-at <epoch seconds> --store <store path>\n";
+	std::cerr << "       " << name << " --iob-bench [--dia <minutes>] [--peak <minutes>]\n";
+	std::cerr << "       " << name << " --sensor [--tz <zone>] <glucose history file>\n";
+	std::cerr << "       " << name << " --learn-opcodes <overlay file> <pump model|auto> <history file>...\n";
+	std::cerr << "       " << name << " --merge [--tz <zone>] [--opcode-overlay <overlay file>] <pump model|auto> <history file>...\n";
+}
+
+int main( int argc, char** argv ) {
+	std::vector<std::string> args;
+	bool detect_model = false;
+	bool pipeline = false;
+	bool merge = false;
+	bool sensor = false;
+	bool iob = false;
+	bool iob_bench = false;
+	bool settings = false;
+	size_t jobs = 1;
+	int64_t settings_at = 0;
+	bool settings_changes = false;
+	bool pump_state = false;
+	int64_t state_at = 0;
+	trace_file_t trace_file;
+	boost::optional<size_t> memory_limit;
+	boost::optional<std::string> cache_path;
+	daw::history::insulin_curve_t curve;
+	// Checked once all arguments are read, --dia and --peak may come in either order
+	auto dia_minutes = curve.dia_minutes;
+	auto peak_minutes = curve.peak_minutes;
+	boost::optional<std::string> store_path;
+	boost::optional<std::string> learn_path;
+	boost::optional<std::string> overlay_path;
+	std::shared_ptr<daw::history::timezone_table const> timezone;
+	for( int n = 1; n < argc; ++n ) {
+		std::string const arg{ argv[n] };
+		if( arg == "--detect-model" ) {
+			detect_model = true;
+		} else if( arg == "--trace" && n + 1 < argc ) {
+			trace_file.file_name = std::string{ argv[++n] };
+			daw::trace::enable( );
+			daw::trace::set_thread_name( "main" );
+		} else if( arg == "--memory-budget" && n + 1 < argc ) {
+			memory_limit = daw::history::parse_memory_size( argv[++n] );
+			if( *memory_limit == 0 ) {
+				std::cerr << "ERROR: Invalid memory budget " << argv[n] << "\n";
+				return EXIT_FAILURE;
 			}
-			auto offset = item ? item->size( ) - 1 : 0;
-			std::cout << (pos-(err_start+offset)) << " ) { ";
-			std::cout << daw::range::make_range( v.data( ) + err_start, v.data( ) + pos - offset ).to_hex_string( ) << " }\n";
-			if( !range.at_end( ) ) {
-				std::cout << std::dec << std::dec << (pos-offset)+1 << "/" << v.size( ) << ": " << item->encode( );
-				entries.push_back( std::move( item ) );
+		} else if( arg == "--page-cache" && n + 1 < argc ) {
+			cache_path = std::string{ argv[++n] };
+		} else if( arg == "--iob" ) {
+			iob = true;
+		} else if( arg == "--settings-at" && n + 1 < argc ) {
+			settings = true;
+			settings_at = static_cast<int64_t>(std::strtoll( argv[++n], nullptr, 10 ));
+		} else if( arg == "--settings-changes" ) {
+			settings_changes = true;
+		} else if( arg == "--state-at" && n + 1 < argc ) {
+			pump_state = true;
+			state_at = static_cast<int64_t>(std::strtoll( argv[++n], nullptr, 10 ));
+		} else if( arg == "--iob-bench" ) {
+			iob_bench = true;
+		} else if( arg == "--dia" && n + 1 < argc ) {
+			dia_minutes = parse_minutes( argv[++n] );
+		} else if( arg == "--peak" && n + 1 < argc ) {
+			peak_minutes = parse_minutes( argv[++n] );
+		} else if( arg == "--sensor" ) {
+			sensor = true;
+		} else if( arg == "--jobs" && n + 1 < argc ) {
+			jobs = static_cast<size_t>(std::strtoul( argv[++n], nullptr, 10 ));
+			if( jobs == 0 ) {
+				jobs = std::max<size_t>( 1, std::thread::hardware_concurrency( ) );
 			}
+		} else if( arg == "--pipeline" ) {
+			pipeline = true;
+		} else if( arg == "--merge" ) {
+			merge = true;
+		} else if( arg == "--store" && n + 1 < argc ) {
+			store_path = std::string{ argv[++n] };
+		} else if( arg == "--learn-opcodes" && n + 1 < argc ) {
+			learn_path = std::string{ argv[++n] };
+		} else if( arg == "--opcode-overlay" && n + 1 < argc ) {
+			overlay_path = std::string{ argv[++n] };
+		} else if( arg == "--tz" && n + 1 < argc ) {
+			try {
+				timezone = daw::history::load_pump_timezone( argv[++n] );
+			} catch( std::runtime_error const & ex ) {
+				std::cerr << "ERROR: " << ex.what( ) << "\n";
+				return EXIT_FAILURE;
+			}
+		} else {
+			args.push_back( arg );
+		}
+	}
+	curve = daw::history::insulin_curve_t{ dia_minutes, peak_minutes };
+	if( !curve.valid( ) ) {
+		std::cerr << "ERROR: --peak must be more than 0 and --dia more than twice --peak\n";
+		show_usage( argv[0] );
+		return EXIT_FAILURE;
+	}
+	if( iob_bench ) {
+		return bench_iob( curve );
+	}
+	if( sensor ) {
+		if( args.size( ) != 1 ) {
+			show_usage( argv[0] );
+			return EXIT_FAILURE;
+		}
+		return decode_sensor_file( args[0], timezone.get( ) );
+	}
+	if( pump_state && store_path && args.empty( ) && !iob && !settings && !settings_changes ) {
+		// Answered from the state kept beside the store, nothing is decoded
+		report_pump_state( daw::history::load_store_pump_state( *store_path ), state_at );
+		return EXIT_SUCCESS;
+	}
+	if( args.size( ) < 2 || (!learn_path && !merge && args.size( ) != 2) ) {
+		show_usage( argv[0] );
+		return EXIT_FAILURE;
+	}
+	boost::optional<daw::history::pump_model_t> claimed_model;
+	if( args[0] == "auto" ) {
+		detect_model = true;
+	} else {
+		claimed_model = daw::history::pump_model_t( args[0] );
+	}
+	if( learn_path && !merge ) {
+		return learn_opcodes( claimed_model, std::vector<std::string>( args.begin( ) + 1, args.end( ) ), *learn_path );
+	}
+	if( overlay_path && !daw::history::load_opcode_overlay( *overlay_path ) ) {
+		std::cerr << "ERROR: Could not load op_code overlay " << *overlay_path << "\n";
+		return EXIT_FAILURE;
+	}
+	if( merge ) {
+		// Only prints the merged records
+		if( pipeline || learn_path || store_path || iob || settings || settings_changes || pump_state || jobs > 1 || memory_limit || cache_path ) {
+			show_usage( argv[0] );
+			return EXIT_FAILURE;
+		}
+		return merge_downloads( claimed_model, detect_model, timezone, std::vector<std::string>( args.begin( ) + 1, args.end( ) ) );
+	}
+	if( pipeline ) {
+		// The pipeline only prints records, the reports and store need the serial path
+		if( !claimed_model || detect_model || store_path || iob || settings || settings_changes || pump_state || jobs > 1 ) {
+			show_usage( argv[0] );
+			return EXIT_FAILURE;
+		}
+		daw::history::history_input_file input{ args[1] };
+		if( !input.is_open( ) ) {
+			std::cerr << "ERROR: Could not open " << args[1] << "\n";
+			return EXIT_FAILURE;
+		}
+		std::unique_ptr<daw::history::memory_budget> budget;
+		daw::history::pipeline_options_t options;
+		if( memory_limit ) {
+			budget = std::make_unique<daw::history::memory_budget>( *memory_limit );
+			options.budget = budget.get( );
+		}
+		std::unique_ptr<daw::history::page_cache> cache;
+		if( cache_path ) {
+			cache = std::make_unique<daw::history::page_cache>( *cache_path );
+			options.cache = cache.get( );
+		}
+		claimed_model->timezone = timezone;
+		auto const stats = daw::history::run_decode_pipeline( input.stream( ), std::cout, *claimed_model, options );
+		for( auto const & stage : stats ) {
+			std::cerr << stage.name << ": " << stage.batches << " pages, busy " << std::chrono::duration_cast<std::chrono::microseconds>( stage.busy ).count( ) << "us, utilisation " << stage.utilisation( ) << "\n";
+		}
+		if( budget ) {
+			report_memory( *budget );
 		}
-		std::cout << "\n\n";
+		if( cache ) {
+			auto const cache_stats = cache->stats( );
+			std::cerr << "page cache: " << cache_stats.hits << " hits, " << cache_stats.misses << " misses, " << cache_stats.evictions << " evictions over " << cache->slots( ) << " slots\n";
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Only the pipeline reads through the page cache
+	if( cache_path || (jobs > 1 && (store_path || iob || settings || settings_changes || pump_state || memory_limit)) ) {
+		show_usage( argv[0] );
+		return EXIT_FAILURE;
+	}
+	// Only one report is produced per run
+	if( static_cast<int>(iob) + static_cast<int>(settings) + static_cast<int>(settings_changes) + static_cast<int>(pump_state) > 1 ) {
+		show_usage( argv[0] );
+		return EXIT_FAILURE;
+	}
+
+	decode_state_t state;
+	state.timezone = timezone;
+	if( store_path ) {
+		state.store = std::make_unique<daw::history::history_store_writer>( *store_path );
+		state.store_records = std::make_unique<daw::history::history_record_table_t>( );
+		state.stored_state = std::make_unique<daw::history::pump_state_history>( daw::history::load_store_pump_state( *store_path ) );
+	}
+	if( iob ) {
+		state.iob = std::make_unique<daw::history::insulin_history_collector>( );
+	} else if( settings || settings_changes ) {
+		state.settings = std::make_unique<std::vector<timed_record_t>>( );
+	} else if( pump_state && !state.stored_state ) {
+		state.pump_state = std::make_unique<std::vector<timed_record_t>>( );
+	}
+
+	if( memory_limit ) {
+		daw::history::memory_budget budget{ *memory_limit };
+		decode_within_budget( args[1], claimed_model, detect_model, state, budget );
+		report_memory( budget );
+	} else {
+		auto v = read_history_bytes( args[1] );
+		auto range = daw::range::make_range( v.data( ), v.data( ) + v.size( ) );
+		state.pump_model = get_pump_model( range, claimed_model, detect_model, state.timezone );
+		if( jobs > 1 ) {
+			decode_parallel( v, *state.pump_model, jobs, state );
+		} else {
+			std::string out;
+			page_spans spans;
+			for( auto && rec : daw::history::decode( range, *state.pump_model ) ) {
+				spans.at( rec.offset( ) );
+				decode_record( rec, v.size( ), state, out );
+				std::cout << out;
+				out.clear( );
+			}
+		}
+	}
+
+	if( iob ) {
+		report_iob( state.iob->take( ), curve );
+	} else if( settings && state.pump_model ) {
+		report_settings( make_settings_history( std::move( *state.settings ), *state.pump_model ), settings_at );
+	} else if( settings_changes && state.pump_model ) {
+		report_settings_changes( make_settings_history( std::move( *state.settings ), *state.pump_model ) );
+	}
+	if( state.store ) {
+		store_download( state );
+		daw::history::save_store_pump_state( *state.stored_state, *store_path, state.store->size( ) );
+	}
+	if( pump_state ) {
+		if( state.stored_state ) {
+			report_pump_state( *state.stored_state, state_at );
+		} else {
+			report_pump_state( std::move( *state.pump_state ), state_at );
+		}
+	}
+	if( state.out_of_order > 0 ) {
+		std::cerr << "WARNING: " << state.out_of_order << " records older than the newest stored record were not added to " << *store_path << "\n";
 	}
 	return EXIT_SUCCESS;
 }
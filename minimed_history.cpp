@@ -0,0 +1,223 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "history_decode.h"
+#include "minimed_history.h"
+#include "timezone.h"
+
+// Exceptions stop at this interface, every function reports a status instead
+
+struct minimed_history_session {
+	// Pages fed in one call, decoded together
+	struct batch_t {
+		uint32_t first_page;
+		daw::history::history_download_t download;
+		size_t next_record;
+		size_t next_error;
+	};	// batch_t
+
+	daw::history::pump_model_t pump_model;
+	daw::history::history_decoder_t decoder;
+	std::vector<uint8_t> partial_page;
+	std::deque<batch_t> batches;
+	uint32_t page_count;
+	std::vector<uint8_t> json_record;
+	std::string json;
+
+	minimed_history_session( std::string const & model, std::shared_ptr<daw::history::timezone_table const> zone ):
+			pump_model{ model },
+			decoder{ daw::history::get_history_decoder( pump_model ) },
+			partial_page{ },
+			batches{ },
+			page_count{ 0 },
+			json_record{ },
+			json{ } {
+
+		pump_model.timezone = std::move( zone );
+	}
+};	// minimed_history_session
+
+namespace {
+	template<typename Func>
+	minimed_history_status guarded( Func func ) noexcept {
+		try {
+			return func( );
+		} catch( std::bad_alloc const & ) {
+			return MINIMED_HISTORY_OUT_OF_MEMORY;
+		} catch( ... ) {
+			return MINIMED_HISTORY_INTERNAL_ERROR;
+		}
+	}
+
+	bool valid_model( char const * model ) {
+		auto const length = std::strlen( model );
+		return length > 0 && length <= 4 && std::all_of( model, model + length, []( char c ) {
+			return std::isdigit( static_cast<unsigned char>(c) ) != 0;
+		} );
+	}
+
+	void decode_pages( minimed_history_session & session, uint8_t const * first, size_t page_count ) {
+		std::vector<uint8_t> bytes( first, first + page_count*daw::history::history_page_size );
+		std::vector<daw::history::data_source_t> pages;
+		for( size_t n = 0; n < page_count; ++n ) {
+			auto const page = bytes.data( ) + n*daw::history::history_page_size;
+			pages.push_back( daw::range::make_range( page, page + daw::history::history_page_size ) );
+		}
+		// The download copies each record's bytes, the pages are not needed after this
+		minimed_history_session::batch_t batch{ session.page_count, daw::history::decode_history_download( pages.data( ), pages.data( ) + pages.size( ), session.pump_model ), 0, 0 };
+		session.page_count += static_cast<uint32_t>(page_count);
+		session.batches.push_back( std::move( batch ) );
+	}
+}	// namespace anonymous
+
+minimed_history_status minimed_history_create( char const * model, char const * zone, minimed_history_session ** session ) {
+	if( !model || !session ) {
+		return MINIMED_HISTORY_INVALID_ARGUMENT;
+	}
+	*session = nullptr;
+	if( !valid_model( model ) ) {
+		return MINIMED_HISTORY_INVALID_MODEL;
+	}
+	return guarded( [&]( ) {
+		std::shared_ptr<daw::history::timezone_table const> timezone;
+		if( zone ) {
+			try {
+				timezone = daw::history::load_pump_timezone( zone );
+			} catch( std::runtime_error const & ) {
+				return MINIMED_HISTORY_INVALID_ZONE;
+			}
+		}
+		*session = new minimed_history_session{ model, std::move( timezone ) };
+		return MINIMED_HISTORY_OK;
+	} );
+}
+
+minimed_history_status minimed_history_feed( minimed_history_session * session, uint8_t const * bytes, size_t size ) {
+	if( !session || (!bytes && size > 0) ) {
+		return MINIMED_HISTORY_INVALID_ARGUMENT;
+	}
+	return guarded( [&]( ) {
+		auto const page_size = daw::history::history_page_size;
+		auto & partial = session->partial_page;
+		if( !partial.empty( ) ) {
+			auto const needed = std::min( size, page_size - partial.size( ) );
+			partial.insert( partial.end( ), bytes, bytes + needed );
+			bytes += needed;
+			size -= needed;
+			if( partial.size( ) < page_size ) {
+				return MINIMED_HISTORY_OK;
+			}
+			decode_pages( *session, partial.data( ), 1 );
+			partial.clear( );
+		}
+		auto const whole_pages = size/page_size;
+		if( whole_pages > 0 ) {
+			decode_pages( *session, bytes, whole_pages );
+		}
+		partial.assign( bytes + whole_pages*page_size, bytes + size );
+		return MINIMED_HISTORY_OK;
+	} );
+}
+
+minimed_history_status minimed_history_next( minimed_history_session * session, minimed_history_record * record ) {
+	if( !session || !record ) {
+		return MINIMED_HISTORY_INVALID_ARGUMENT;
+	}
+	return guarded( [&]( ) {
+		auto & batches = session->batches;
+		while( !batches.empty( ) ) {
+			auto & batch = batches.front( );
+			auto const & records = batch.download.records;
+			auto const & errors = batch.download.errors;
+			auto const has_record = batch.next_record < records.size( );
+			auto const has_error = batch.next_error < errors.size( );
+			if( !has_record && !has_error ) {
+				batches.pop_front( );
+				continue;
+			}
+			// Records and unrecognised spans are kept apart, merge them back into page order
+			auto const use_error = has_error && (!has_record || errors[batch.next_error].page < records.pages[batch.next_record]
+				|| (errors[batch.next_error].page == records.pages[batch.next_record] && errors[batch.next_error].offset < records.offsets[batch.next_record]));
+			uint32_t page = 0;
+			if( use_error ) {
+				// The error's bytes were not kept by the download
+				auto const & error = errors[batch.next_error++];
+				page = error.page;
+				*record = minimed_history_record{ INT64_MIN, nullptr, error.size, batch.first_page + error.page, error.offset, 0, MINIMED_HISTORY_RECORD_ERROR };
+			} else {
+				auto const n = batch.next_record++;
+				page = records.pages[n];
+				*record = minimed_history_record{ records.timestamps[n], records.data.data( ) + records.data_offsets[n], records.sizes[n], batch.first_page + page, records.offsets[n], records.op_codes[n], 0 };
+			}
+			if( batch.download.pages[page].status != daw::history::page_status_t::ok ) {
+				record->flags |= MINIMED_HISTORY_RECORD_BAD_CRC;
+			}
+			return MINIMED_HISTORY_OK;
+		}
+		return MINIMED_HISTORY_END;
+	} );
+}
+
+minimed_history_status minimed_history_record_json( minimed_history_session * session, minimed_history_record const * record, char const ** json ) {
+	if( !session || !record || !json || !record->data || (record->flags & MINIMED_HISTORY_RECORD_ERROR) != 0 ) {
+		return MINIMED_HISTORY_INVALID_ARGUMENT;
+	}
+	return guarded( [&]( ) {
+		session->json_record.assign( record->data, record->data + record->size );
+		auto data = daw::range::make_range( session->json_record.data( ), session->json_record.data( ) + session->json_record.size( ) );
+		size_t position = record->offset;
+		auto const entry = session->decoder( data, session->pump_model, position );
+		if( !entry ) {
+			return MINIMED_HISTORY_INVALID_ARGUMENT;
+		}
+		session->json = entry->encode( );
+		*json = session->json.c_str( );
+		return MINIMED_HISTORY_OK;
+	} );
+}
+
+void minimed_history_destroy( minimed_history_session * session ) {
+	delete session;
+}
+
+char const * minimed_history_status_string( minimed_history_status status ) {
+	switch( status ) {
+	case MINIMED_HISTORY_OK: return "ok";
+	case MINIMED_HISTORY_END: return "no more records";
+	case MINIMED_HISTORY_INVALID_ARGUMENT: return "invalid argument";
+	case MINIMED_HISTORY_INVALID_MODEL: return "invalid pump model";
+	case MINIMED_HISTORY_OUT_OF_MEMORY: return "out of memory";
+	case MINIMED_HISTORY_INTERNAL_ERROR: return "internal error";
+	case MINIMED_HISTORY_INVALID_ZONE: return "invalid timezone";
+	}
+	return "unknown status";
+}
@@ -0,0 +1,187 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "opcode_learning.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			// Enough consecutive entries that a wrong length is unlikely to line up by chance
+			constexpr size_t const frames_to_confirm = 4;
+		}	// namespace anonymous
+
+		opcode_learner::opcode_learner( pump_model_t const & pump_model, size_t max_size ):
+			m_framer{ pump_model },
+			m_max_size{ max_size },
+			m_size_votes{ },
+			m_timestamp_votes{ } { }
+
+		// Counts the entries that frame after an op_code entry of size bytes at the front of
+		// page, framing later occurrences of op_code with the same candidate size
+		size_t opcode_learner::frames_after( data_source_t const & page, uint8_t op_code, size_t size, size_t padding_start ) const {
+			size_t offset = size;
+			size_t result = 0;
+			while( result < frames_to_confirm ) {
+				if( offset >= padding_start ) {
+					// running cleanly into the padding at the end of the page confirms the chain
+					return frames_to_confirm;
+				}
+				if( page[offset] == 0 ) {
+					// zero bytes frame as skip entries anywhere and prove nothing
+					++offset;
+					continue;
+				}
+				if( page[offset] == op_code ) {
+					offset += size;
+					++result;
+					continue;
+				}
+				auto const entry = page.slice( offset );
+				auto const layout = m_framer.frame( entry );
+				// a wrong size often lands on a byte that happens to be a known op_code, the
+				// timestamp inside it is what gives it away
+				if( !layout || (layout->timestamp_size > 0 && !has_valid_timestamp( entry, *layout )) ) {
+					break;
+				}
+				offset += layout->size;
+				++result;
+			}
+			return result;
+		}
+
+		void opcode_learner::add_page( data_source_t const & page ) {
+			auto padding_start = page.size( );
+			while( padding_start > 0 && page[padding_start - 1] == 0 ) {
+				--padding_start;
+			}
+			size_t offset = 0;
+			while( offset < page.size( ) ) {
+				auto const frame = m_framer.next( page, offset );
+				if( frame.kind != history_frame_kind_t::error ) {
+					offset += frame.size;
+					continue;
+				}
+				uint8_t const op_code = page[offset];
+				size_t best_size = 0;
+				size_t best_frames = 0;
+				for( size_t size = 2; size <= m_max_size && offset + size <= page.size( ); ++size ) {
+					auto const frames = frames_after( page.slice( offset ), op_code, size, padding_start - offset );
+					if( frames > best_frames ) {
+						best_frames = frames;
+						best_size = size;
+					}
+				}
+				if( best_frames < frames_to_confirm ) {
+					// nothing lines up, let the framer resync past it
+					offset += frame.size;
+					continue;
+				}
+				++m_size_votes[std::make_pair( op_code, best_size )];
+				auto const entry = page.slice( offset, offset + best_size );
+				for( size_t ts_offset = 1; ts_offset + 5 <= best_size; ++ts_offset ) {
+					if( has_valid_timestamp( entry, record_layout_t{ best_size, ts_offset, 5 } ) ) {
+						++m_timestamp_votes[std::make_tuple( op_code, best_size, ts_offset )];
+					}
+				}
+				offset += best_size;
+			}
+		}
+
+		std::vector<learned_opcode_t> opcode_learner::results( size_t min_occurrences ) const {
+			std::vector<learned_opcode_t> result;
+			auto it = m_size_votes.begin( );
+			while( it != m_size_votes.end( ) ) {
+				auto const op_code = it->first.first;
+				size_t total = 0;
+				auto best = it;
+				for( ; it != m_size_votes.end( ) && it->first.first == op_code; ++it ) {
+					total += it->second;
+					if( it->second > best->second ) {
+						best = it;
+					}
+				}
+				if( best->second < min_occurrences ) {
+					continue;
+				}
+				auto const size = best->first.second;
+				// The standard offset of 2 wins ties, otherwise a timestamp has to be valid in
+				// most occurrences to count
+				record_layout_t layout{ size, 0, 0 };
+				size_t best_ts_votes = best->second / 2;
+				for( size_t ts_offset = 1; ts_offset + 5 <= size; ++ts_offset ) {
+					auto const votes = m_timestamp_votes.find( std::make_tuple( op_code, size, ts_offset ) );
+					if( votes == m_timestamp_votes.end( ) ) {
+						continue;
+					}
+					if( votes->second > best_ts_votes || (votes->second == best_ts_votes && ts_offset == 2) ) {
+						best_ts_votes = votes->second;
+						layout.timestamp_offset = ts_offset;
+						layout.timestamp_size = 5;
+					}
+				}
+				result.push_back( learned_opcode_t{ op_code, layout, total, static_cast<double>(best->second)/static_cast<double>(total) } );
+			}
+			return result;
+		}
+
+		bool save_opcode_overlay( std::string const & file_name, std::vector<learned_opcode_t> const & opcodes ) {
+			std::ofstream ofs( file_name.c_str( ) );
+			if( !ofs ) {
+				return false;
+			}
+			ofs << "# op_code size timestamp_offset timestamp_size occurrences confidence\n";
+			for( auto const & opcode : opcodes ) {
+				ofs << std::hex << std::setw( 2 ) << std::setfill( '0' ) << static_cast<int>(opcode.op_code) << std::dec;
+				ofs << " " << opcode.layout.size << " " << opcode.layout.timestamp_offset << " " << opcode.layout.timestamp_size;
+				ofs << " " << opcode.occurrences << " " << opcode.confidence << "\n";
+			}
+			return static_cast<bool>(ofs);
+		}
+
+		bool load_opcode_overlay( std::string const & file_name ) {
+			std::ifstream ifs( file_name.c_str( ) );
+			if( !ifs ) {
+				return false;
+			}
+			std::string line;
+			while( std::getline( ifs, line ) ) {
+				if( line.empty( ) || line[0] == '#' ) {
+					continue;
+				}
+				std::istringstream iss( line );
+				unsigned int op_code = 0;
+				record_layout_t layout{ 0, 0, 0 };
+				if( !(iss >> std::hex >> op_code >> std::dec >> layout.size >> layout.timestamp_offset >> layout.timestamp_size) ) {
+					return false;
+				}
+				if( op_code > 0xFF || layout.size == 0 || layout.timestamp_offset + layout.timestamp_size > layout.size ) {
+					return false;
+				}
+				set_opcode_overlay( static_cast<uint8_t>(op_code), layout );
+			}
+			return true;
+		}
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,314 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/interprocess/sync/sharable_lock.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "page_cache.h"
+#include "timezone.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			constexpr uint64_t const cache_magic = 0x4548434147444D4Dull;	// MMDGCACHE
+			constexpr uint32_t const cache_version = 1;
+			constexpr size_t const max_cached_records = (cache_slot_size - sizeof( cache_slot_t ))/sizeof( cached_record_t );
+
+			static_assert( ATOMIC_LLONG_LOCK_FREE == 2, "The cache is shared between processes and needs lock free 64bit atomics" );
+			static_assert( sizeof( cached_record_t ) == 16, "cached_record_t is part of the file format" );
+			static_assert( sizeof( cache_slot_t ) == 24, "cache_slot_t is part of the file format" );
+
+			uint64_t mix( uint64_t value ) noexcept {
+				value ^= value >> 33;
+				value *= 0xFF51AFD7ED558CCDull;
+				value ^= value >> 33;
+				value *= 0xC4CEB9FE1A85EC53ull;
+				value ^= value >> 33;
+				return value;
+			}
+
+			// Cached timestamps are in UTC, so pages read in another zone are cached apart.  Without
+			// a zone they were converted at this process's offset, which is part of the key instead
+			uint64_t zone_hash( pump_model_t const & pump_model ) noexcept {
+				if( !pump_model.timezone ) {
+					return mix( 0x4C4F43414Cull ^ static_cast<uint64_t>(static_cast<uint32_t>(seconds_from_gmt( ))) << 24 );	// "LOCAL"
+				}
+				uint64_t result = 0;
+				for( auto c : pump_model.timezone->name( ) ) {
+					result = mix( result ^ static_cast<uint8_t>(c) );
+				}
+				return result;
+			}
+
+			// Everything besides the page and model that changes how it is framed
+			uint64_t framing_hash( framing_options_t const & options ) noexcept {
+				auto const years = static_cast<uint64_t>(options.min_resync_year) | static_cast<uint64_t>(options.max_resync_year) << 16;
+				return mix( mix( years ^ static_cast<uint64_t>(options.max_error_span) << 32 ) ^ opcode_overlay_hash( ) );
+			}
+
+			uint64_t cache_key( data_source_t const & page, pump_model_t const & pump_model, framing_options_t const & options ) noexcept {
+				auto const key = mix( hash_page( page ) ^ (static_cast<uint64_t>(pump_model.generation) << 48) ^ zone_hash( pump_model ) ^ framing_hash( options ) );
+				return key == 0 ? 1 : key;
+			}
+
+			size_t file_size( std::string const & path ) {
+				std::ifstream file( path.c_str( ), std::ios::binary | std::ios::ate );
+				return file ? static_cast<size_t>(file.tellg( )) : 0;
+			}
+
+			size_t cache_file_size( uint32_t sets ) {
+				return sizeof( cache_header_t ) + static_cast<size_t>(sets)*cache_ways*cache_slot_size;
+			}
+		}	// namespace anonymous
+
+		void frame_page( data_source_t const & body, history_framer const & framer, std::vector<cached_record_t> & records ) {
+			records.clear( );
+			size_t offset = 0;
+			while( offset < body.size( ) ) {
+				auto const frame = framer.next( body, offset );
+				auto const data = body.slice( offset, offset + frame.size );
+				switch( frame.kind ) {
+				case history_frame_kind_t::padding:
+					break;
+				case history_frame_kind_t::record: {
+						auto const ts = parse_history_timestamp( data, frame.layout, framer.timezone( ) );
+						records.push_back( cached_record_t{ ts ? to_epoch_seconds( *ts ) : no_timestamp, static_cast<uint16_t>(offset), static_cast<uint16_t>(frame.size), data[0], frame.kind,
+								static_cast<uint8_t>(frame.layout.timestamp_offset), static_cast<uint8_t>(frame.layout.timestamp_size) } );
+					}
+					break;
+				case history_frame_kind_t::error:
+					records.push_back( cached_record_t{ no_timestamp, static_cast<uint16_t>(offset), static_cast<uint16_t>(frame.size), data[0], frame.kind, 0, 0 } );
+					break;
+				}
+				offset += frame.size;
+			}
+		}
+
+		history_frame_t to_frame( cached_record_t const & record ) {
+			return history_frame_t{ record.kind, record.offset, record.size, record_layout_t{ record.size, record.timestamp_offset, record.timestamp_size } };
+		}
+
+		uint64_t hash_page( data_source_t const & page ) noexcept {
+			auto first = page.begin( );
+			auto const size = page.size( );
+			uint64_t result = 0x9E3779B97F4A7C15ull ^ size;
+			size_t n = 0;
+			for( ; n + 8 <= size; n += 8 ) {
+				uint64_t word;
+				std::memcpy( &word, &first[n], sizeof( word ) );
+				result = (result ^ mix( word ))*0x9E3779B97F4A7C15ull;
+				result = (result << 31) | (result >> 33);
+			}
+			uint64_t tail = 0;
+			for( size_t shift = 0; n < size; ++n, shift += 8 ) {
+				tail |= static_cast<uint64_t>(first[n]) << shift;
+			}
+			return mix( result ^ mix( tail ) );
+		}
+
+		page_cache::page_cache( std::string path, size_t capacity ):
+				m_path{ std::move( path ) },
+				m_lock{ },
+				m_region{ },
+				m_mutex{ } {
+
+			namespace ip = boost::interprocess;
+			// POSIX drops a process's file lock when it closes any descriptor of the locked
+			// file, so the lock is on a file nothing else opens
+			auto const lock_path = m_path + ".lock";
+			for( auto const & name : { m_path, lock_path } ) {
+				std::ofstream touch( name.c_str( ), std::ios::binary | std::ios::app );
+				if( !touch ) {
+					throw std::runtime_error( "Could not open page cache " + name );
+				}
+			}
+			m_lock = ip::file_lock( lock_path.c_str( ) );
+			ip::scoped_lock<ip::file_lock> lock( m_lock );
+
+			auto size = file_size( m_path );
+			bool valid = false;
+			if( size >= sizeof( cache_header_t ) ) {
+				ip::file_mapping mapping( m_path.c_str( ), ip::read_write );
+				m_region = ip::mapped_region( mapping, ip::read_write );
+				auto const & h = header( );
+				valid = h.magic == cache_magic && h.version == cache_version && h.sets > 0 && size == cache_file_size( h.sets );
+			}
+			if( !valid ) {
+				m_region = ip::mapped_region( );
+				auto const sets = static_cast<uint32_t>(std::max<size_t>( 1, capacity/(static_cast<size_t>(cache_ways)*cache_slot_size) ));
+				size = cache_file_size( sets );
+				{
+					std::ofstream file( m_path.c_str( ), std::ios::binary | std::ios::trunc );
+					file.seekp( static_cast<std::streamoff>(size - 1) );
+					file.put( 0 );
+					if( !file ) {
+						throw std::runtime_error( "Could not create page cache " + m_path );
+					}
+				}
+				ip::file_mapping mapping( m_path.c_str( ), ip::read_write );
+				m_region = ip::mapped_region( mapping, ip::read_write );
+				auto & h = header( );
+				h.version = cache_version;
+				h.sets = sets;
+				h.magic = cache_magic;
+				m_region.flush( 0, sizeof( cache_header_t ) );
+			}
+		}
+
+		page_cache::~page_cache( ) { }
+
+		cache_header_t & page_cache::header( ) const {
+			return *static_cast<cache_header_t *>(m_region.get_address( ));
+		}
+
+		cache_slot_t & page_cache::slot( size_t n ) const {
+			auto const base = static_cast<char *>(m_region.get_address( )) + sizeof( cache_header_t );
+			return *reinterpret_cast<cache_slot_t *>(base + n*cache_slot_size);
+		}
+
+		cached_record_t * page_cache::records( cache_slot_t & s ) const {
+			return reinterpret_cast<cached_record_t *>(reinterpret_cast<char *>(&s) + sizeof( cache_slot_t ));
+		}
+
+		size_t page_cache::slots( ) const {
+			return static_cast<size_t>(header( ).sets)*cache_ways;
+		}
+
+		bool page_cache::lookup( data_source_t const & page, pump_model_t const & pump_model, framing_options_t const & options, std::vector<cached_record_t> & result, page_status_t & status ) {
+			namespace ip = boost::interprocess;
+			auto const key = cache_key( page, pump_model, options );
+			auto & h = header( );
+			auto const first = static_cast<size_t>(key % h.sets)*cache_ways;
+
+			std::lock_guard<std::mutex> guard( m_mutex );
+			ip::sharable_lock<ip::file_lock> lock( m_lock );
+			for( size_t n = first; n < first + cache_ways; ++n ) {
+				auto & s = slot( n );
+				if( s.key.load( ) != key ) {
+					continue;
+				}
+				auto const data = records( s );
+				result.assign( data, data + s.count );
+				status = s.status;
+				s.last_used.store( h.clock.fetch_add( 1 ) + 1, std::memory_order_relaxed );
+				h.hits.fetch_add( 1, std::memory_order_relaxed );
+				return true;
+			}
+			h.misses.fetch_add( 1, std::memory_order_relaxed );
+			return false;
+		}
+
+		void page_cache::store( data_source_t const & page, pump_model_t const & pump_model, framing_options_t const & options, std::vector<cached_record_t> const & data, page_status_t status ) {
+			namespace ip = boost::interprocess;
+			if( data.size( ) > max_cached_records ) {
+				return;
+			}
+			auto const key = cache_key( page, pump_model, options );
+			auto & h = header( );
+			auto const first = static_cast<size_t>(key % h.sets)*cache_ways;
+
+			std::lock_guard<std::mutex> guard( m_mutex );
+			ip::scoped_lock<ip::file_lock> lock( m_lock );
+			auto victim = first;
+			for( size_t n = first; n < first + cache_ways; ++n ) {
+				auto const slot_key = slot( n ).key.load( );
+				if( slot_key == key ) {
+					return;	// another process got there first
+				}
+				if( slot_key == 0 ) {
+					victim = n;
+					break;
+				}
+				if( slot( n ).last_used.load( ) < slot( victim ).last_used.load( ) ) {
+					victim = n;
+				}
+			}
+			auto & s = slot( victim );
+			if( s.key.load( ) != 0 ) {
+				h.evictions.fetch_add( 1, std::memory_order_relaxed );
+			}
+			s.key.store( 0 );
+			s.count = static_cast<uint32_t>(data.size( ));
+			s.status = status;
+			std::copy( data.begin( ), data.end( ), records( s ) );
+			s.last_used.store( h.clock.fetch_add( 1 ) + 1 );
+			s.key.store( key );
+			h.inserts.fetch_add( 1, std::memory_order_relaxed );
+		}
+
+		page_cache_stats_t page_cache::stats( ) const {
+			auto const & h = header( );
+			return page_cache_stats_t{ h.hits.load( ), h.misses.load( ), h.inserts.load( ), h.evictions.load( ) };
+		}
+
+		history_download_t decode_history_download( data_source_t const * first_page, data_source_t const * last_page, pump_model_t const & pump_model, page_cache & cache, framing_options_t const & options ) {
+			history_download_t result;
+			history_framer const framer{ pump_model, options };
+			result.pages.reserve( static_cast<size_t>(last_page - first_page) );
+
+			auto & records = result.records;
+			std::vector<cached_record_t> cached;
+			for( auto page = first_page; page != last_page; ++page ) {
+				auto const page_index = static_cast<uint32_t>(page - first_page);
+				history_page_status_t status{ page_status_t::ok, 0, 0 };
+				if( page->size( ) < 2 ) {
+					status.status = page_status_t::too_short;
+					result.pages.push_back( status );
+					continue;
+				}
+				auto const body = page->shrink( page->size( ) - 2 );
+				if( !cache.lookup( *page, pump_model, options, cached, status.status ) ) {
+					status.status = check_page_crc( *page ) ? page_status_t::ok : page_status_t::crc_mismatch;
+					frame_page( body, framer, cached );
+					cache.store( *page, pump_model, options, cached, status.status );
+				}
+				for( auto const & rec : cached ) {
+					if( rec.kind == history_frame_kind_t::error ) {
+						result.errors.push_back( history_error_span_t{ page_index, rec.offset, rec.size } );
+						status.error_bytes += rec.size;
+						continue;
+					}
+					auto const data = body.slice( rec.offset, rec.offset + rec.size );
+					records.op_codes.push_back( rec.op_code );
+					records.timestamps.push_back( rec.timestamp );
+					records.pages.push_back( page_index );
+					records.offsets.push_back( rec.offset );
+					records.sizes.push_back( rec.size );
+					records.data_offsets.push_back( static_cast<uint32_t>(records.data.size( )) );
+					records.data.insert( records.data.end( ), data.begin( ), data.end( ) );
+					++status.records;
+				}
+				result.pages.push_back( status );
+			}
+			return result;
+		}
+
+		history_download_t decode_history_download( data_source_t download, pump_model_t const & pump_model, page_cache & cache, framing_options_t const & options ) {
+			auto const pages = split_history_pages( std::move( download ) );
+			return decode_history_download( pages.data( ), pages.data( ) + pages.size( ), pump_model, cache, options );
+		}
+	}	// namespace history
+}	// namespace daw
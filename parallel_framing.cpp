@@ -0,0 +1,164 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <thread>
+#include "parallel_framing.h"
+#include "trace.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			constexpr size_t const no_frame = std::numeric_limits<size_t>::max( );
+
+			// Every frame framed from a chunk's candidates.  Chains that reach an offset already
+			// framed link to it, so each offset in the chunk is framed at most once
+			struct chunk_chains_t {
+				size_t first;
+				size_t last;
+				std::vector<history_frame_t> frames;
+				std::vector<size_t> next;	// the frame after frames[n] in this chunk or no_frame
+				std::vector<size_t> at_offset;	// frame starting at first + n or no_frame
+
+				chunk_chains_t( size_t first_offset, size_t last_offset ):
+					first{ first_offset },
+					last{ last_offset },
+					frames{ },
+					next{ },
+					at_offset( last_offset - first_offset, no_frame ) { }
+
+				size_t find( size_t offset ) const {
+					if( offset < first || offset >= last ) {
+						return no_frame;
+					}
+					return at_offset[offset - first];
+				}
+			};	// chunk_chains_t
+
+			void frame_chains( data_source_t const & buffer, history_framer const & framer, size_t candidates, chunk_chains_t & chunk ) {
+				daw::trace::scoped_span const span{ "frame_chunk", "frame", "offset", static_cast<int64_t>(chunk.first) };
+				auto const candidate_end = std::min( chunk.last, chunk.first + candidates );
+				for( auto start = chunk.first; start < candidate_end; ++start ) {
+					if( chunk.find( start ) != no_frame ) {
+						continue;
+					}
+					auto offset = start;
+					auto previous = no_frame;
+					while( offset < chunk.last ) {
+						auto const existing = chunk.find( offset );
+						if( existing != no_frame ) {
+							if( previous != no_frame ) {
+								chunk.next[previous] = existing;
+							}
+							break;
+						}
+						auto const index = chunk.frames.size( );
+						chunk.frames.push_back( framer.next( buffer, offset ) );
+						chunk.next.push_back( no_frame );
+						chunk.at_offset[offset - chunk.first] = index;
+						if( previous != no_frame ) {
+							chunk.next[previous] = index;
+						}
+						previous = index;
+						offset += chunk.frames.back( ).size;
+					}
+				}
+			}
+
+			void append_frame( std::vector<history_frame_t> & frames, history_frame_t const & frame ) {
+				if( frame.kind != history_frame_kind_t::padding ) {
+					frames.push_back( frame );
+				}
+			}
+		}	// namespace anonymous
+
+		parallel_framing_options_t::parallel_framing_options_t( ):
+			threads{ 0 },
+			min_chunk_size{ 64*1024 },
+			candidates{ 16 } { }
+
+		std::vector<history_frame_t> frame_history_parallel( data_source_t const & buffer, history_framer const & framer, parallel_framing_options_t const & options, parallel_framing_stats_t * stats ) {
+			auto threads = options.threads;
+			if( threads == 0 ) {
+				threads = std::max<size_t>( 1, std::thread::hardware_concurrency( ) );
+			}
+			// A few chunks a thread so an error heavy chunk does not hold up the rest
+			auto const chunk_size = std::max( std::max<size_t>( 1, options.min_chunk_size ), buffer.size( )/(threads*4) + 1 );
+			std::vector<chunk_chains_t> chunks;
+			for( size_t first = 0; first < buffer.size( ); first += chunk_size ) {
+				chunks.emplace_back( first, std::min( buffer.size( ), first + chunk_size ) );
+			}
+			threads = std::min( threads, chunks.size( ) );
+
+			// The first chunk starts on a real boundary and only needs the one chain
+			std::atomic<size_t> next_chunk{ 0 };
+			auto const worker = [&]( ) {
+				for( auto n = next_chunk++; n < chunks.size( ); n = next_chunk++ ) {
+					frame_chains( buffer, framer, n == 0 ? 1 : options.candidates, chunks[n] );
+				}
+			};
+			std::vector<std::thread> workers;
+			for( size_t n = 1; n < threads; ++n ) {
+				workers.emplace_back( worker );
+			}
+			worker( );
+			for( auto & t : workers ) {
+				t.join( );
+			}
+
+			daw::trace::scoped_span const span{ "stitch", "frame" };
+			parallel_framing_stats_t result_stats{ chunks.size( ), 0, 0 };
+			std::vector<history_frame_t> result;
+			size_t offset = 0;
+			for( auto const & chunk : chunks ) {
+				if( offset >= chunk.last ) {
+					// An unrecognised span from an earlier chunk covered all of this one
+					continue;
+				}
+				assert( offset >= chunk.first );
+				auto index = chunk.find( offset );
+				if( index != no_frame ) {
+					++result_stats.stitched;
+				}
+				while( index == no_frame && offset < chunk.last ) {
+					auto const frame = framer.next( buffer, offset );
+					result_stats.reframed_bytes += frame.size;
+					append_frame( result, frame );
+					offset += frame.size;
+					index = chunk.find( offset );
+				}
+				for( ; index != no_frame; index = chunk.next[index] ) {
+					auto const & frame = chunk.frames[index];
+					append_frame( result, frame );
+					offset = frame.offset + frame.size;
+				}
+			}
+			if( stats ) {
+				*stats = result_stats;
+			}
+			return result;
+		}
+	}	// namespace history
+}	// namespace daw
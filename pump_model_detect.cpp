@@ -0,0 +1,121 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "pump_model_detect.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			template<typename Traits>
+			double score_framing( data_source_t page ) {
+				size_t framed = 0;
+				size_t unframed = 0;
+				size_t good_timestamps = 0;
+				size_t bad_timestamps = 0;
+				while( !page.at_end( ) ) {
+					if( page[0] == 0 ) {
+						// padding at the end of a page frames under every model
+						page.advance( 1 );
+						continue;
+					}
+					auto layout = frame_history_entry<Traits>( page );
+					if( !layout ) {
+						++unframed;
+						page.advance( 1 );
+						continue;
+					}
+					if( layout->timestamp_size > 0 ) {
+						if( has_valid_timestamp( page, *layout ) ) {
+							++good_timestamps;
+						} else {
+							++bad_timestamps;
+						}
+					}
+					framed += layout->size;
+					page.advance( static_cast<data_source_t::difference_type>(layout->size) );
+				}
+				if( framed + unframed == 0 ) {
+					return 0.0;
+				}
+				auto const framing = static_cast<double>(framed)/static_cast<double>(framed + unframed);
+				auto const timestamps = static_cast<double>(good_timestamps + 1)/static_cast<double>(good_timestamps + bad_timestamps + 1);
+				return framing * timestamps;
+			}
+
+			pump_model_t representative_model( pump_family_t family ) {
+				switch( family ) {
+					case pump_family_t::small: return pump_model_t{ "522" };
+					case pump_family_t::large: return pump_model_t{ "523" };
+					case pump_family_t::low_suspend: return pump_model_t{ "551" };
+				}
+				return pump_model_t{ "523" };
+			}
+		}	// namespace anonymous
+
+		pump_model_guess_t detect_pump_family( data_source_t page, boost::optional<pump_family_t> hint ) {
+			pump_model_guess_t result{ pump_family_t::small, 0.0, { score_framing<small_pump_traits>( page ), score_framing<large_pump_traits>( page ), score_framing<low_suspend_pump_traits>( page ) } };
+
+			size_t best = hint ? static_cast<size_t>(*hint) : 0;
+			for( size_t n = 0; n < 3; ++n ) {
+				if( result.scores[n] > result.scores[best] ) {
+					best = n;
+				}
+			}
+			// Families that tie the winner frame this page identically, so the margin is taken
+			// against the best family that would decode it differently
+			double runner_up = 0.0;
+			bool has_runner_up = false;
+			for( size_t n = 0; n < 3; ++n ) {
+				if( result.scores[n] < result.scores[best] && result.scores[n] >= runner_up ) {
+					runner_up = result.scores[n];
+					has_runner_up = true;
+				}
+			}
+			result.family = static_cast<pump_family_t>(best);
+			if( has_runner_up && result.scores[best] > 0.0 ) {
+				result.confidence = (result.scores[best] - runner_up)/result.scores[best];
+			}
+			return result;
+		}
+
+		std::string to_string( pump_family_t family ) {
+			switch( family ) {
+				case pump_family_t::small: return "small";
+				case pump_family_t::large: return "large";
+				case pump_family_t::low_suspend: return "low_suspend";
+			}
+			return "unknown";
+		}
+
+		pump_model_t resolve_pump_model( data_source_t page, boost::optional<pump_model_t> const & claimed, pump_model_guess_t * guess ) {
+			auto const hint = claimed ? claimed->family( ) : boost::optional<pump_family_t>{ };
+			auto result = detect_pump_family( std::move( page ), hint );
+			if( guess ) {
+				*guess = result;
+			}
+			if( claimed && claimed->family( ) == result.family ) {
+				return *claimed;
+			}
+			return representative_model( result.family );
+		}
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,363 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include "history_store.h"
+#include "pump_state.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			// Smallest record the reducer reads its arguments from, 0 for other op_codes
+			size_t pump_state_record_size( uint8_t op_code ) {
+				switch( op_code ) {
+					case 0x14:	// select basal profile
+					case 0x16:	// temp basal duration
+					case 0x19:	// low battery
+					case 0x1A:	// battery changed
+					case 0x1E:	// suspend
+					case 0x1F:	// resume
+					case 0x21:	// rewind
+					case 0x34:	// low reservoir
+					case 0x62:	// change temp basal type
+					case 0x64:	// change time format
+						return 7;
+					case 0x33:	// temp basal
+						return 8;
+					case 0x03:	// prime
+					case 0x7B:	// basal profile start
+						return 10;
+					default:
+						return 0;
+				}
+			}
+
+			pump_state_event_t make_event( uint8_t op_code, int64_t epoch, std::vector<uint8_t> const & record ) {
+				pump_state_event_t result{ epoch, op_code, { 0, 0 } };
+				switch( op_code ) {
+					case 0x03:
+						result.args[0] = record[2];
+						result.args[1] = record[4];
+						break;
+					case 0x33:
+						result.args[0] = record[1];
+						result.args[1] = record[7];
+						break;
+					case 0x7B:
+						result.args[0] = record[1];
+						result.args[1] = record[8];
+						break;
+					default:
+						result.args[0] = record[1];
+						break;
+				}
+				return result;
+			}
+
+			// <store path>.state is this header, the latest state, the events and then the
+			// checkpoints as a uint64_t next event followed by the state
+			struct pump_state_file_header_t {
+				uint64_t magic;
+				uint32_t version;
+				uint32_t reserved;
+				uint64_t store_records;
+				uint64_t checkpoint_events;
+				int64_t checkpoint_seconds;
+				uint64_t event_count;
+				uint64_t checkpoint_count;
+				uint64_t reserved2;
+			};	// pump_state_file_header_t
+
+			constexpr uint64_t const pump_state_magic = 0x31545350444D4D00ull;	// "\0MMDPST1"
+			constexpr uint32_t const pump_state_version = 1;
+
+			static_assert( sizeof( pump_state_file_header_t ) == 64, "pump_state_file_header_t is part of the file format" );
+			static_assert( sizeof( pump_state_event_t ) == 16, "pump_state_event_t is part of the file format" );
+			static_assert( sizeof( pump_state_t ) == 88, "pump_state_t is part of the file format" );
+
+			template<typename T>
+			void write_pod( std::ofstream & ofs, T const & value ) {
+				ofs.write( reinterpret_cast<char const *>(&value), sizeof( T ) );
+			}
+
+			template<typename T>
+			bool read_pod( std::ifstream & ifs, T & value ) {
+				return static_cast<bool>(ifs.read( reinterpret_cast<char *>(&value), sizeof( T ) ));
+			}
+		}	// namespace anonymous
+
+		bool is_pump_state_op_code( uint8_t op_code ) {
+			return pump_state_record_size( op_code ) != 0;
+		}
+
+		pump_state_t::pump_state_t( ):
+			epoch{ no_timestamp },
+			suspended_since{ no_timestamp },
+			temp_basal_start{ no_timestamp },
+			temp_basal_end{ no_timestamp },
+			last_rewind{ no_timestamp },
+			last_prime{ no_timestamp },
+			last_battery_change{ no_timestamp },
+			last_low_battery{ no_timestamp },
+			last_low_reservoir{ no_timestamp },
+			temp_basal_rate{ 0 },
+			basal_rate{ 0 },
+			last_prime_amount{ 0 },
+			basal_profile{ 0 },
+			temp_basal_percent{ false },
+			temp_basal_type_percent{ false },
+			time_format_24hr{ false } { }
+
+		bool pump_state_t::suspended( ) const {
+			return suspended_since != no_timestamp;
+		}
+
+		bool pump_state_t::temp_basal_running( ) const {
+			return temp_basal_end != no_timestamp;
+		}
+
+		void apply_pump_state( pump_state_t & state, pump_state_event_t const & event ) {
+			state.epoch = event.epoch;
+			switch( event.op_code ) {
+				case 0x03:
+					state.last_prime = event.epoch;
+					state.last_prime_amount = static_cast<uint16_t>(static_cast<uint16_t>(event.args[1]) << 2);
+					break;
+				case 0x14:
+					state.basal_profile = event.args[0];
+					break;
+				case 0x16:
+					// A temp basal record comes first with the rate, a duration of 0 cancels it
+					if( event.args[0] == 0 ) {
+						state.temp_basal_start = no_timestamp;
+						state.temp_basal_end = no_timestamp;
+					} else {
+						state.temp_basal_start = event.epoch;
+						state.temp_basal_end = event.epoch + static_cast<int64_t>(event.args[0])*30*60;
+					}
+					break;
+				case 0x19:
+					state.last_low_battery = event.epoch;
+					break;
+				case 0x1A:
+					state.last_battery_change = event.epoch;
+					break;
+				case 0x1E:
+					if( !state.suspended( ) ) {
+						state.suspended_since = event.epoch;
+					}
+					break;
+				case 0x1F:
+					state.suspended_since = no_timestamp;
+					break;
+				case 0x21:
+					state.last_rewind = event.epoch;
+					break;
+				case 0x33:
+					state.temp_basal_percent = (event.args[1] >> 3) != 0;
+					state.temp_basal_rate = event.args[0];
+					break;
+				case 0x34:
+					state.last_low_reservoir = event.epoch;
+					break;
+				case 0x62:
+					state.temp_basal_type_percent = event.args[0] == 1;
+					break;
+				case 0x64:
+					state.time_format_24hr = event.args[0] == 1;
+					break;
+				case 0x7B:
+					state.basal_rate = event.args[1];
+					break;
+			}
+		}
+
+		pump_state_options_t::pump_state_options_t( ):
+			checkpoint_events{ 256 },
+			checkpoint_seconds{ 24*60*60 } { }
+
+		pump_state_history::pump_state_history( pump_state_options_t options ):
+				m_options{ std::move( options ) },
+				m_events{ },
+				m_checkpoints{ },
+				m_latest{ },
+				m_stats{ } {
+
+			m_options.checkpoint_events = std::max<size_t>( 1, m_options.checkpoint_events );
+		}
+
+		bool pump_state_history::add( history_entry_obj const & entry ) {
+			if( !is_pump_state_op_code( entry.op_code( ) ) ) {
+				return false;
+			}
+			auto const ts = entry.timestamp( );
+			if( !ts ) {
+				return false;
+			}
+			return add( entry.op_code( ), to_epoch_seconds( *ts ), entry.data( ) );
+		}
+
+		bool pump_state_history::add( uint8_t op_code, int64_t epoch, std::vector<uint8_t> const & record ) {
+			auto const record_size = pump_state_record_size( op_code );
+			if( record_size == 0 || record.size( ) < record_size || epoch == no_timestamp ) {
+				return false;
+			}
+			++m_stats.records;
+			if( !m_events.empty( ) && epoch < m_latest.epoch ) {
+				++m_stats.out_of_order;
+				return false;
+			}
+			m_events.push_back( make_event( op_code, epoch, record ) );
+			apply_pump_state( m_latest, m_events.back( ) );
+			++m_stats.events;
+
+			auto const last_checkpoint = m_checkpoints.empty( ) ? checkpoint_t{ 0, pump_state_t{ } } : m_checkpoints.back( );
+			auto const since_epoch = m_checkpoints.empty( ) ? m_events.front( ).epoch : last_checkpoint.state.epoch;
+			if( m_events.size( ) - last_checkpoint.next_event >= m_options.checkpoint_events || epoch - since_epoch >= m_options.checkpoint_seconds ) {
+				m_checkpoints.push_back( checkpoint_t{ m_events.size( ), m_latest } );
+				++m_stats.checkpoints;
+			}
+			return true;
+		}
+
+		pump_state_t pump_state_history::at( int64_t epoch ) const {
+			// The last checkpoint at or before epoch
+			auto const pos = std::upper_bound( m_checkpoints.begin( ), m_checkpoints.end( ), epoch, []( int64_t value, checkpoint_t const & checkpoint ) {
+				return value < checkpoint.state.epoch;
+			} );
+			pump_state_t result{ };
+			size_t next_event = 0;
+			if( pos != m_checkpoints.begin( ) ) {
+				result = std::prev( pos )->state;
+				next_event = std::prev( pos )->next_event;
+			}
+			for( ; next_event < m_events.size( ) && m_events[next_event].epoch <= epoch; ++next_event ) {
+				apply_pump_state( result, m_events[next_event] );
+			}
+			if( result.temp_basal_running( ) && result.temp_basal_end <= epoch ) {
+				result.temp_basal_start = no_timestamp;
+				result.temp_basal_end = no_timestamp;
+			}
+			return result;
+		}
+
+		pump_state_t const & pump_state_history::latest( ) const {
+			return m_latest;
+		}
+
+		std::vector<pump_state_event_t> const & pump_state_history::events( ) const {
+			return m_events;
+		}
+
+		pump_state_stats_t const & pump_state_history::stats( ) const {
+			return m_stats;
+		}
+
+		void pump_state_history::save( std::string const & path, uint64_t store_records ) const {
+			// Written beside the old file and renamed over it so a reader never sees half of one
+			auto const temp_path = path + ".tmp";
+			{
+				std::ofstream ofs( temp_path.c_str( ), std::ios::binary | std::ios::trunc );
+				if( !ofs ) {
+					throw std::runtime_error( "Could not create pump state file " + temp_path );
+				}
+				pump_state_file_header_t const header{ pump_state_magic, pump_state_version, 0, store_records, m_options.checkpoint_events, m_options.checkpoint_seconds, m_events.size( ), m_checkpoints.size( ), 0 };
+				write_pod( ofs, header );
+				write_pod( ofs, m_latest );
+				ofs.write( reinterpret_cast<char const *>(m_events.data( )), static_cast<std::streamsize>(m_events.size( )*sizeof( pump_state_event_t )) );
+				for( auto const & checkpoint : m_checkpoints ) {
+					write_pod( ofs, static_cast<uint64_t>(checkpoint.next_event) );
+					write_pod( ofs, checkpoint.state );
+				}
+				if( !ofs.flush( ) ) {
+					throw std::runtime_error( "Could not write pump state file " + temp_path );
+				}
+			}
+			if( std::rename( temp_path.c_str( ), path.c_str( ) ) != 0 ) {
+				throw std::runtime_error( "Could not replace pump state file " + path );
+			}
+		}
+
+		bool pump_state_history::load( std::string const & path, uint64_t store_records ) {
+			std::ifstream ifs( path.c_str( ), std::ios::binary );
+			pump_state_file_header_t header;
+			if( !ifs || !read_pod( ifs, header ) || header.magic != pump_state_magic || header.version != pump_state_version || header.store_records != store_records ) {
+				return false;
+			}
+			pump_state_t latest;
+			std::vector<pump_state_event_t> events( static_cast<size_t>(header.event_count) );
+			if( !read_pod( ifs, latest ) || !ifs.read( reinterpret_cast<char *>(events.data( )), static_cast<std::streamsize>(events.size( )*sizeof( pump_state_event_t )) ) ) {
+				return false;
+			}
+			std::vector<checkpoint_t> checkpoints;
+			checkpoints.reserve( static_cast<size_t>(header.checkpoint_count) );
+			for( uint64_t n = 0; n < header.checkpoint_count; ++n ) {
+				uint64_t next_event;
+				pump_state_t state;
+				if( !read_pod( ifs, next_event ) || !read_pod( ifs, state ) || next_event > events.size( ) ) {
+					return false;
+				}
+				checkpoints.push_back( checkpoint_t{ static_cast<size_t>(next_event), state } );
+			}
+			m_options.checkpoint_events = std::max<size_t>( 1, static_cast<size_t>(header.checkpoint_events) );
+			m_options.checkpoint_seconds = header.checkpoint_seconds;
+			m_events = std::move( events );
+			m_checkpoints = std::move( checkpoints );
+			m_latest = latest;
+			m_stats = pump_state_stats_t{ m_events.size( ), 0, m_events.size( ), m_checkpoints.size( ) };
+			return true;
+		}
+
+		pump_state_history load_store_pump_state( std::string const & store_path ) {
+			history_store_reader const store{ store_path };
+			pump_state_history result;
+			if( result.load( store_path + ".state", store.size( ) ) ) {
+				return result;
+			}
+			std::vector<history_store_record_t> records;
+			for( unsigned op_code = 0; op_code <= std::numeric_limits<uint8_t>::max( ); ++op_code ) {
+				if( is_pump_state_op_code( static_cast<uint8_t>(op_code) ) ) {
+					auto found = store.find( static_cast<uint8_t>(op_code), std::numeric_limits<int64_t>::min( ), std::numeric_limits<int64_t>::max( ) );
+					records.insert( records.end( ), found.begin( ), found.end( ) );
+				}
+			}
+			// The raw bytes are in store order, which is timestamp order
+			std::sort( records.begin( ), records.end( ), []( history_store_record_t const & a, history_store_record_t const & b ) {
+				return a.data < b.data;
+			} );
+			for( auto const & record : records ) {
+				if( record.has_timestamp ) {
+					result.add( record.op_code, record.timestamp, std::vector<uint8_t>( record.data, record.data + record.size ) );
+				}
+			}
+			return result;
+		}
+
+		void save_store_pump_state( pump_state_history const & history, std::string const & store_path, uint64_t store_records ) {
+			history.save( store_path + ".state", store_records );
+		}
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,348 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The minimed_history Python extension.  Pages are decoded in process and every column is
+// exposed through the buffer protocol, so numpy.asarray( column ) shares the decoder's memory
+//
+//	import minimed_history, numpy
+//	history = minimed_history.decode_file( "history.hex", "523", "America/Toronto" )
+//	boluses = history.columns( 0x01 )
+//	amounts = numpy.asarray( boluses["amount"] )
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include "history_columns.h"
+#include "history_decode.h"
+#include "history_input.h"
+#include "timezone.h"
+
+namespace {
+	// Everything a History owns.  Columns point into it and keep the History alive
+	struct decoded_history_t {
+		std::vector<uint8_t> pages;
+		daw::history::history_download_t download;
+		std::vector<daw::history::history_columns_t> columns;
+	};	// decoded_history_t
+
+	struct history_object_t {
+		PyObject_HEAD
+		decoded_history_t * history;
+	};	// history_object_t
+
+	struct column_object_t {
+		PyObject_HEAD
+		PyObject * owner;
+		void * data;
+		Py_ssize_t length;
+		Py_ssize_t item_size;
+		char const * format;
+	};	// column_object_t
+
+	// Struct module format characters for the column element types
+	template<typename T> struct buffer_format;
+	template<> struct buffer_format<uint8_t> { static constexpr char const * value = "B"; };
+	template<> struct buffer_format<uint32_t> { static constexpr char const * value = "I"; };
+	template<> struct buffer_format<int64_t> { static constexpr char const * value = "q"; };
+	template<> struct buffer_format<double> { static constexpr char const * value = "d"; };
+
+	int column_getbuffer( PyObject * obj, Py_buffer * view, int flags ) {
+		if( (flags & PyBUF_WRITABLE) == PyBUF_WRITABLE ) {
+			PyErr_SetString( PyExc_BufferError, "minimed_history columns are read only" );
+			view->obj = nullptr;
+			return -1;
+		}
+		auto const self = reinterpret_cast<column_object_t *>( obj );
+		view->obj = obj;
+		Py_INCREF( obj );
+		view->buf = self->data;
+		view->len = self->length * self->item_size;
+		view->readonly = 1;
+		view->itemsize = self->item_size;
+		view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? const_cast<char *>( self->format ) : nullptr;
+		view->ndim = 1;
+		view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &self->length : nullptr;
+		view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->item_size : nullptr;
+		view->suboffsets = nullptr;
+		view->internal = nullptr;
+		return 0;
+	}
+
+	void column_dealloc( PyObject * obj ) {
+		auto const self = reinterpret_cast<column_object_t *>( obj );
+		Py_XDECREF( self->owner );
+		Py_TYPE( obj )->tp_free( obj );
+	}
+
+	Py_ssize_t column_length( PyObject * obj ) {
+		return reinterpret_cast<column_object_t *>( obj )->length;
+	}
+
+	PyBufferProcs column_buffer_procs = { column_getbuffer, nullptr };
+	PySequenceMethods column_sequence_methods = { column_length };
+
+	PyTypeObject column_type = {
+		PyVarObject_HEAD_INIT( nullptr, 0 )
+	};
+
+	void history_dealloc( PyObject * obj ) {
+		auto const self = reinterpret_cast<history_object_t *>( obj );
+		delete self->history;
+		Py_TYPE( obj )->tp_free( obj );
+	}
+
+	PyTypeObject history_type = {
+		PyVarObject_HEAD_INIT( nullptr, 0 )
+	};
+
+	template<typename T>
+	PyObject * make_column( PyObject * owner, std::vector<T> const & values ) {
+		auto const result = PyObject_New( column_object_t, &column_type );
+		if( !result ) {
+			return nullptr;
+		}
+		Py_INCREF( owner );
+		result->owner = owner;
+		result->data = const_cast<T *>( values.data( ) );
+		result->length = static_cast<Py_ssize_t>(values.size( ));
+		result->item_size = static_cast<Py_ssize_t>(sizeof( T ));
+		result->format = buffer_format<T>::value;
+		return reinterpret_cast<PyObject *>( result );
+	}
+
+	// Steals column
+	bool set_column( PyObject * dict, char const * name, PyObject * column ) {
+		if( !column ) {
+			return false;
+		}
+		auto const ok = PyDict_SetItemString( dict, name, column ) == 0;
+		Py_DECREF( column );
+		return ok;
+	}
+
+	PyObject * history_op_codes( PyObject * obj, PyObject * ) {
+		auto const self = reinterpret_cast<history_object_t *>( obj );
+		auto const result = PyList_New( 0 );
+		if( !result ) {
+			return nullptr;
+		}
+		for( auto const & table : self->history->columns ) {
+			auto const op_code = PyLong_FromLong( table.op_code );
+			if( !op_code || PyList_Append( result, op_code ) != 0 ) {
+				Py_XDECREF( op_code );
+				Py_DECREF( result );
+				return nullptr;
+			}
+			Py_DECREF( op_code );
+		}
+		return result;
+	}
+
+	PyObject * history_columns( PyObject * obj, PyObject * args ) {
+		int op_code = 0;
+		if( !PyArg_ParseTuple( args, "i", &op_code ) ) {
+			return nullptr;
+		}
+		auto const self = reinterpret_cast<history_object_t *>( obj );
+		auto const result = PyDict_New( );
+		if( !result ) {
+			return nullptr;
+		}
+		for( auto const & table : self->history->columns ) {
+			if( table.op_code != op_code ) {
+				continue;
+			}
+			if( !set_column( result, "timestamp", make_column( obj, table.timestamps ) ) ) {
+				Py_DECREF( result );
+				return nullptr;
+			}
+			for( size_t n = 0; n < table.names.size( ); ++n ) {
+				if( !set_column( result, table.names[n].c_str( ), make_column( obj, table.values[n] ) ) ) {
+					Py_DECREF( result );
+					return nullptr;
+				}
+			}
+		}
+		return result;
+	}
+
+	PyObject * history_records( PyObject * obj, PyObject * ) {
+		auto const self = reinterpret_cast<history_object_t *>( obj );
+		auto const & records = self->history->download.records;
+		auto const result = PyDict_New( );
+		if( !result ) {
+			return nullptr;
+		}
+		if( !set_column( result, "op_code", make_column( obj, records.op_codes ) )
+				|| !set_column( result, "timestamp", make_column( obj, records.timestamps ) )
+				|| !set_column( result, "page", make_column( obj, records.pages ) )
+				|| !set_column( result, "offset", make_column( obj, records.offsets ) )
+				|| !set_column( result, "size", make_column( obj, records.sizes ) ) ) {
+			Py_DECREF( result );
+			return nullptr;
+		}
+		return result;
+	}
+
+	PyObject * history_errors( PyObject * obj, void * ) {
+		auto const self = reinterpret_cast<history_object_t *>( obj );
+		return PyLong_FromSize_t( self->history->download.errors.size( ) );
+	}
+
+	PyObject * history_pages( PyObject * obj, void * ) {
+		auto const self = reinterpret_cast<history_object_t *>( obj );
+		return PyLong_FromSize_t( self->history->download.pages.size( ) );
+	}
+
+	PyMethodDef history_methods[] = {
+		{ "op_codes", history_op_codes, METH_NOARGS, "The op_codes present, in order" },
+		{ "columns", history_columns, METH_VARARGS, "columns( op_code ) -> { name: column } of the op_code's decoded fields and timestamps" },
+		{ "records", history_records, METH_NOARGS, "{ name: column } of the op_code, timestamp, page, offset and size of every record" },
+		{ nullptr, nullptr, 0, nullptr }
+	};
+
+	PyGetSetDef history_getset[] = {
+		{ const_cast<char *>( "errors" ), history_errors, nullptr, const_cast<char *>( "Number of unrecognised spans" ), nullptr },
+		{ const_cast<char *>( "pages" ), history_pages, nullptr, const_cast<char *>( "Number of pages decoded" ), nullptr },
+		{ nullptr, nullptr, nullptr, nullptr, nullptr }
+	};
+
+	// Takes ownership of history.  Timestamps are converted to UTC from zone, or from this
+	// process's local time when it is nullptr
+	PyObject * make_history( std::unique_ptr<decoded_history_t> history, std::string const & model, char const * zone ) {
+		daw::history::pump_model_t pump_model{ model };
+		if( zone ) {
+			pump_model.timezone = daw::history::load_pump_timezone( zone );
+		}
+		std::exception_ptr error;
+		// The GIL is not needed while decoding, exceptions wait until it is held again
+		Py_BEGIN_ALLOW_THREADS
+		try {
+			auto const range = daw::range::make_range( history->pages.data( ), history->pages.data( ) + history->pages.size( ) );
+			history->download = daw::history::decode_history_download( range, pump_model );
+			history->columns = daw::history::decode_history_columns( history->download, pump_model );
+		} catch( ... ) {
+			error = std::current_exception( );
+		}
+		Py_END_ALLOW_THREADS
+		if( error ) {
+			std::rethrow_exception( error );
+		}
+		auto const result = PyObject_New( history_object_t, &history_type );
+		if( !result ) {
+			return nullptr;
+		}
+		result->history = history.release( );
+		return reinterpret_cast<PyObject *>( result );
+	}
+
+	PyObject * module_decode( PyObject *, PyObject * args ) {
+		Py_buffer pages;
+		char const * model = nullptr;
+		char const * zone = nullptr;
+		if( !PyArg_ParseTuple( args, "y*s|z", &pages, &model, &zone ) ) {
+			return nullptr;
+		}
+		try {
+			auto history = std::make_unique<decoded_history_t>( );
+			auto const first = static_cast<uint8_t const *>( pages.buf );
+			history->pages.assign( first, first + pages.len );
+			PyBuffer_Release( &pages );
+			return make_history( std::move( history ), model, zone );
+		} catch( std::exception const & ex ) {
+			PyBuffer_Release( &pages );
+			PyErr_SetString( PyExc_RuntimeError, ex.what( ) );
+			return nullptr;
+		}
+	}
+
+	PyObject * module_decode_file( PyObject *, PyObject * args ) {
+		char const * file_name = nullptr;
+		char const * model = nullptr;
+		char const * zone = nullptr;
+		if( !PyArg_ParseTuple( args, "ss|z", &file_name, &model, &zone ) ) {
+			return nullptr;
+		}
+		try {
+			auto history = std::make_unique<decoded_history_t>( );
+			daw::history::history_input_file input{ file_name };
+			if( !input.is_open( ) ) {
+				PyErr_Format( PyExc_OSError, "Could not open %s", file_name );
+				return nullptr;
+			}
+			daw::history::history_page_reader reader{ input.stream( ) };
+			std::vector<uint8_t> page;
+			while( reader.next_raw( page ) ) {
+				history->pages.insert( history->pages.end( ), page.begin( ), page.end( ) );
+			}
+			return make_history( std::move( history ), model, zone );
+		} catch( std::exception const & ex ) {
+			PyErr_SetString( PyExc_RuntimeError, ex.what( ) );
+			return nullptr;
+		}
+	}
+
+	PyMethodDef module_methods[] = {
+		{ "decode", module_decode, METH_VARARGS, "decode( pages, model, zone=None ) -> History from binary pages, each with its CRC, timestamps converted to UTC from zone" },
+		{ "decode_file", module_decode_file, METH_VARARGS, "decode_file( file_name, model, zone=None ) -> History from a hex or binary file, optionally compressed, timestamps converted to UTC from zone" },
+		{ nullptr, nullptr, 0, nullptr }
+	};
+
+	PyModuleDef module_def = {
+		PyModuleDef_HEAD_INIT,
+		"minimed_history",
+		"Decodes Medtronic pump history pages into columns",
+		-1,
+		module_methods,
+		nullptr,
+		nullptr,
+		nullptr,
+		nullptr
+	};
+}	// namespace anonymous
+
+PyMODINIT_FUNC PyInit_minimed_history( ) {
+	column_type.tp_name = "minimed_history.Column";
+	column_type.tp_basicsize = sizeof( column_object_t );
+	column_type.tp_dealloc = column_dealloc;
+	column_type.tp_as_buffer = &column_buffer_procs;
+	column_type.tp_as_sequence = &column_sequence_methods;
+	column_type.tp_flags = Py_TPFLAGS_DEFAULT;
+	column_type.tp_doc = "A read only column of decoded values, use it through the buffer protocol";
+
+	history_type.tp_name = "minimed_history.History";
+	history_type.tp_basicsize = sizeof( history_object_t );
+	history_type.tp_dealloc = history_dealloc;
+	history_type.tp_methods = history_methods;
+	history_type.tp_getset = history_getset;
+	history_type.tp_flags = Py_TPFLAGS_DEFAULT;
+	history_type.tp_doc = "Decoded history pages";
+
+	if( PyType_Ready( &column_type ) < 0 || PyType_Ready( &history_type ) < 0 ) {
+		return nullptr;
+	}
+	return PyModule_Create( &module_def );
+}
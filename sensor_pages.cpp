@@ -0,0 +1,254 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include "sensor_pages.h"
+#include "timezone.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			struct sensor_segment_t {
+				uint32_t offset;
+				uint32_t size;
+				uint8_t op_code;	// 0 for a run of glucose readings
+			};	// sensor_segment_t
+
+			// Frames a page body from the end, newest entry first
+			void frame_sensor_page( data_source_t const & body, uint32_t page_index, std::vector<sensor_segment_t> & segments, sensor_download_t & result, history_page_status_t & status ) {
+				auto pos = static_cast<uint32_t>(body.size( ));
+				while( pos > 0 ) {
+					auto const op_code = body[pos - 1];
+					if( op_code == 0 ) {
+						--pos;
+						continue;
+					}
+					if( op_code >= sensor_glucose_min_op ) {
+						auto start = pos - 1;
+						while( start > 0 && body[start - 1] >= sensor_glucose_min_op ) {
+							--start;
+						}
+						segments.push_back( sensor_segment_t{ start, pos - start, 0 } );
+						pos = start;
+						continue;
+					}
+					auto const size = sensor_event_size( op_code );
+					if( size == 0 || size > pos ) {
+						result.errors.push_back( history_error_span_t{ page_index, pos - 1, 1 } );
+						++status.error_bytes;
+						--pos;
+						continue;
+					}
+					segments.push_back( sensor_segment_t{ pos - size, size, op_code } );
+					pos -= size;
+				}
+				std::reverse( segments.begin( ), segments.end( ) );
+			}
+
+			int64_t sensor_epoch( data_source_t const & data, timezone_table const * zone ) {
+				auto const ts = parse_sensor_timestamp( data );
+				if( !ts ) {
+					return no_timestamp;
+				}
+				auto const local_seconds = to_epoch_seconds( *ts );
+				return local_seconds - utc_offset_at_local( zone, local_seconds );
+			}
+
+			// Readings first to last - 1 end at epoch, 5 minutes apart
+			void time_back_from( sensor_glucose_t * first, sensor_glucose_t * last, int64_t epoch ) {
+				auto const count = last - first;
+				for( ptrdiff_t n = 0; n < count; ++n ) {
+					first[n].epoch = epoch - (count - 1 - n)*sensor_reading_interval;
+				}
+			}
+
+			// Readings first to last - 1 follow a reference at epoch
+			void time_forward_from( sensor_glucose_t * first, sensor_glucose_t * last, int64_t epoch ) {
+				auto const count = last - first;
+				for( ptrdiff_t n = 0; n < count; ++n ) {
+					first[n].epoch = epoch + (n + 1)*sensor_reading_interval;
+					first[n].flags |= sensor_flags::extrapolated;
+				}
+			}
+
+			void decode_sensor_page( data_source_t const & body, uint32_t page_index, timezone_table const * zone, std::vector<sensor_segment_t> & segments, sensor_download_t & result, history_page_status_t & status ) {
+				segments.clear( );
+				frame_sensor_page( body, page_index, segments, result, status );
+
+				auto & glucose = result.glucose;
+				auto pending = glucose.size( );	// first reading without a time yet
+				int64_t last_reference = no_timestamp;
+				uint8_t next_flags = 0;
+				for( auto const & segment : segments ) {
+					if( segment.op_code == 0 ) {
+						// A whole run of readings in one pass, the times are filled in once the
+						// next sensor timestamp is known
+						auto const first = body.begin( ) + segment.offset;
+						auto const start = glucose.size( );
+						glucose.resize( start + segment.size );
+						auto out = glucose.data( ) + start;
+						for( uint32_t n = 0; n < segment.size; ++n ) {
+							out[n] = sensor_glucose_t{ no_timestamp, static_cast<uint16_t>(first[n]*2u), 0 };
+						}
+						out[0].flags = next_flags;
+						next_flags = 0;
+						status.records += segment.size;
+						continue;
+					}
+					auto const data = body.slice( segment.offset, segment.offset + segment.size );
+					int64_t epoch = no_timestamp;
+					if( segment.size >= 5 ) {
+						epoch = sensor_epoch( data, zone );
+					}
+					result.events.push_back( sensor_event_t{ epoch, page_index, segment.offset, segment.op_code, static_cast<uint8_t>(segment.size) } );
+					++status.records;
+					switch( segment.op_code ) {
+					case 0x02:
+						next_flags |= sensor_flags::weak_signal;
+						break;
+					case 0x03:
+						next_flags |= sensor_flags::calibration;
+						break;
+					case sensor_timestamp_op:
+						if( epoch != no_timestamp ) {
+							time_back_from( glucose.data( ) + pending, glucose.data( ) + glucose.size( ), epoch );
+							pending = glucose.size( );
+							last_reference = epoch;
+						}
+						break;
+					}
+				}
+				auto const first = glucose.data( ) + pending;
+				auto const last = glucose.data( ) + glucose.size( );
+				if( last_reference != no_timestamp ) {
+					time_forward_from( first, last, last_reference );
+				} else {
+					std::for_each( first, last, []( sensor_glucose_t & reading ) {
+						reading.flags |= sensor_flags::untimed;
+					} );
+				}
+			}
+		}	// namespace anonymous
+
+		std::string sensor_op_string( uint8_t op_code ) {
+			if( op_code >= sensor_glucose_min_op ) {
+				return "GlucoseSensorData";
+			}
+			switch( op_code ) {
+			case 0x01: return "DataEnd";
+			case 0x02: return "SensorWeakSignal";
+			case 0x03: return "SensorCal";
+			case 0x07: return "Fokko7";
+			case 0x08: return "SensorTimestamp";
+			case 0x0A: return "BatteryChange";
+			case 0x0B: return "SensorStatus";
+			case 0x0C: return "DateTimeChange";
+			case 0x0D: return "SensorSync";
+			case 0x0E: return "CalBGForGH";
+			case 0x0F: return "SensorCalFactor";
+			case 0x10: return "SensorEvent10";
+			case 0x13: return "SensorEvent13";
+			default: return "UnknownSensorEvent";
+			}
+		}
+
+		uint8_t sensor_event_size( uint8_t op_code ) noexcept {
+			switch( op_code ) {
+			case 0x01:
+			case 0x02:
+			case 0x13:
+				return 1;
+			case 0x03:
+			case 0x07:
+				return 2;
+			case 0x08:
+			case 0x0A:
+			case 0x0B:
+			case 0x0C:
+			case 0x0D:
+				return 5;
+			case 0x0E:
+				return 6;
+			case 0x0F:
+				return 7;
+			case 0x10:
+				return 8;
+			default:
+				return 0;
+			}
+		}
+
+		boost::optional<boost::posix_time::ptime> parse_sensor_timestamp( data_source_t const & data ) noexcept {
+			if( data.size( ) < 4 ) {
+				return boost::optional<boost::posix_time::ptime>{ };
+			}
+			uint8_t const hour = data[0] & 0b00011111;
+			uint8_t const minute = data[1] & 0b00111111;
+			uint8_t const day = data[2] & 0b00011111;
+			uint8_t const month = ((data[0] >> 4) & 0b00001100) + (data[1] >> 6);
+			uint16_t const year = 2000 + (data[3] & 0b01111111);
+			if( day < 1 || day > 31 || month < 1 || month > 12 || hour > 23 || minute > 59 ) {
+				return boost::optional<boost::posix_time::ptime>{ };
+			}
+			try {
+				using namespace boost::posix_time;
+				using namespace boost::gregorian;
+				return ptime{ date{ year, month, day }, time_duration{ hour, minute, 0 } };
+			} catch( ... ) {
+				return boost::optional<boost::posix_time::ptime>{ };
+			}
+		}
+
+		sensor_download_t decode_sensor_download( data_source_t const * first_page, data_source_t const * last_page, timezone_table const * zone ) {
+			sensor_download_t result;
+			size_t total_bytes = 0;
+			for( auto page = first_page; page != last_page; ++page ) {
+				total_bytes += page->size( );
+			}
+			// Nearly every byte of a glucose page is a reading
+			result.glucose.reserve( total_bytes );
+			result.pages.reserve( static_cast<size_t>(last_page - first_page) );
+
+			std::vector<sensor_segment_t> segments;
+			for( auto page = first_page; page != last_page; ++page ) {
+				auto const page_index = static_cast<uint32_t>(page - first_page);
+				history_page_status_t status{ page_status_t::ok, 0, 0 };
+				if( page->size( ) < 2 ) {
+					status.status = page_status_t::too_short;
+					result.pages.push_back( status );
+					continue;
+				}
+				if( !check_page_crc( *page ) ) {
+					status.status = page_status_t::crc_mismatch;
+				}
+				decode_sensor_page( page->shrink( page->size( ) - 2 ), page_index, zone, segments, result, status );
+				result.pages.push_back( status );
+			}
+			return result;
+		}
+
+		sensor_download_t decode_sensor_download( data_source_t download, timezone_table const * zone ) {
+			auto const pages = split_history_pages( std::move( download ) );
+			return decode_sensor_download( pages.data( ), pages.data( ) + pages.size( ), zone );
+		}
+	}	// namespace history
+}	// namespace daw
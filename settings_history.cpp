@@ -0,0 +1,185 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <cassert>
+#include "history_decode.h"
+#include "settings_history.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			// Every settings record has its timestamp here
+			constexpr size_t const settings_timestamp_offset = 2;
+			constexpr size_t const settings_timestamp_size = 5;
+			// Runs closer than this are stored as one, a run costs an offset and a length
+			constexpr size_t const run_gap = 4;
+			constexpr size_t const run_overhead = 3;
+
+			bool same_settings( std::vector<uint8_t> const & a, std::vector<uint8_t> const & b ) {
+				if( a.size( ) != b.size( ) ) {
+					return false;
+				}
+				auto const ts_last = settings_timestamp_offset + settings_timestamp_size;
+				return std::equal( a.begin( ), a.begin( ) + settings_timestamp_offset, b.begin( ) )
+					&& std::equal( a.begin( ) + ts_last, a.end( ), b.begin( ) + ts_last );
+			}
+
+			std::vector<settings_byte_run_t> diff_settings( std::vector<uint8_t> const & from, std::vector<uint8_t> const & to ) {
+				assert( from.size( ) == to.size( ) );
+				std::vector<settings_byte_run_t> result;
+				size_t pos = 0;
+				while( pos < to.size( ) ) {
+					if( from[pos] == to[pos] ) {
+						++pos;
+						continue;
+					}
+					auto const first = pos;
+					auto last = pos + 1;
+					// last moves on with each difference, so the run ends after run_gap equal bytes
+					for( size_t n = last; n < to.size( ) && n < last + run_gap; ++n ) {
+						if( from[n] != to[n] ) {
+							last = n + 1;
+						}
+					}
+					result.push_back( settings_byte_run_t{ static_cast<uint16_t>(first), std::vector<uint8_t>( to.begin( ) + first, to.begin( ) + last ) } );
+					pos = last;
+				}
+				return result;
+			}
+		}	// namespace anonymous
+
+		bool is_settings_op_code( uint8_t op_code ) {
+			switch( op_code ) {
+				case 0x08:
+				case 0x09:
+				case 0x50:
+				case 0x5A:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		settings_history::settings_history( pump_model_t pump_model, size_t checkpoint_interval ):
+				m_pump_model{ std::move( pump_model ) },
+				m_checkpoint_interval{ std::max<size_t>( 1, checkpoint_interval ) },
+				m_tracks{ },
+				m_stats{ } { }
+
+		bool settings_history::add( history_entry_obj const & entry ) {
+			if( !is_settings_op_code( entry.op_code( ) ) ) {
+				return false;
+			}
+			auto const ts = entry.timestamp( );
+			if( !ts ) {
+				return false;
+			}
+			return add( entry.op_code( ), to_epoch_seconds( *ts ), entry.data( ) );
+		}
+
+		bool settings_history::add( uint8_t op_code, int64_t epoch, std::vector<uint8_t> const & record ) {
+			if( !is_settings_op_code( op_code ) || record.size( ) < settings_timestamp_offset + settings_timestamp_size ) {
+				return false;
+			}
+			++m_stats.records;
+			auto & track = m_tracks[op_code];
+			if( !track.changes.empty( ) ) {
+				if( epoch < track.changes.back( ).epoch ) {
+					++m_stats.out_of_order;
+					return false;
+				}
+				if( same_settings( track.latest, record ) ) {
+					++m_stats.unchanged;
+					return true;
+				}
+			}
+			settings_change_t change{ epoch, { }, { } };
+			if( track.changes.empty( ) || track.since_checkpoint + 1 >= m_checkpoint_interval || track.latest.size( ) != record.size( ) ) {
+				change.checkpoint = record;
+				track.since_checkpoint = 0;
+				m_stats.stored_bytes += record.size( );
+			} else {
+				change.runs = diff_settings( track.latest, record );
+				++track.since_checkpoint;
+				for( auto const & run : change.runs ) {
+					m_stats.stored_bytes += run_overhead + run.bytes.size( );
+				}
+			}
+			m_stats.record_bytes += record.size( );
+			track.changes.push_back( std::move( change ) );
+			track.latest = record;
+			return true;
+		}
+
+		std::vector<uint8_t> settings_history::rebuild( track_t const & track, size_t change ) const {
+			auto first = change;
+			while( track.changes[first].checkpoint.empty( ) ) {
+				assert( first > 0 );
+				--first;
+			}
+			auto result = track.changes[first].checkpoint;
+			for( auto n = first + 1; n <= change; ++n ) {
+				for( auto const & run : track.changes[n].runs ) {
+					std::copy( run.bytes.begin( ), run.bytes.end( ), result.begin( ) + run.offset );
+				}
+			}
+			return result;
+		}
+
+		std::unique_ptr<history_entry_obj> settings_history::at( uint8_t op_code, int64_t epoch ) const {
+			auto const pos = m_tracks.find( op_code );
+			if( pos == m_tracks.end( ) ) {
+				return nullptr;
+			}
+			auto const & changes = pos->second.changes;
+			auto const after = std::upper_bound( changes.begin( ), changes.end( ), epoch, []( int64_t value, settings_change_t const & change ) {
+				return value < change.epoch;
+			} );
+			if( after == changes.begin( ) ) {
+				return nullptr;
+			}
+			auto record = rebuild( pos->second, static_cast<size_t>(std::distance( changes.begin( ), after ) - 1) );
+			auto data = daw::range::make_range( record.data( ), record.data( ) + record.size( ) );
+			size_t position = 0;
+			return get_history_decoder( m_pump_model )( data, m_pump_model, position );
+		}
+
+		std::vector<uint8_t> settings_history::op_codes( ) const {
+			std::vector<uint8_t> result;
+			for( auto const & track : m_tracks ) {
+				result.push_back( track.first );
+			}
+			return result;
+		}
+
+		std::vector<settings_change_t> const & settings_history::changes( uint8_t op_code ) const {
+			static std::vector<settings_change_t> const empty{ };
+			auto const pos = m_tracks.find( op_code );
+			return pos == m_tracks.end( ) ? empty : pos->second.changes;
+		}
+
+		settings_history_stats_t const & settings_history::stats( ) const {
+			return m_stats;
+		}
+	}	// namespace history
+}	// namespace daw
@@ -0,0 +1,196 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Decodes malformed input for every pump family and checks it is handled as bounded work.
+//	- every truncation of a random entry for each op_code, straight through the decoder and
+//	  through framing
+//	- random buffers, buffers of one unknown op_code and truncated entries run together
+// The per byte cost of the malformed buffers is then compared with a clean dump of the same
+// size.  Exits with 0 when nothing read out of bounds and every cost was within max_slowdown
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "history_range.h"
+
+namespace {
+	using namespace daw::history;
+
+	size_t const entry_bytes = 256;	// more than any entry
+	size_t const trials_per_op_code = 8;
+	size_t const buffer_bytes = 1u << 20;
+	// Resyncing and rejecting entries may cost more than decoding them, but only by a constant
+	double const max_slowdown = 10.0;
+
+	int failures = 0;
+
+	void fail( std::string const & what ) {
+		std::cout << "FAILED: " << what << "\n";
+		++failures;
+	}
+
+	data_source_t make_source( std::vector<uint8_t> & bytes ) {
+		return daw::range::make_range( bytes.data( ), bytes.data( ) + bytes.size( ) );
+	}
+
+	// Frames and decodes all of bytes, returning the records decoded
+	size_t decode_all( std::vector<uint8_t> & bytes, pump_model_t const & pump_model ) {
+		size_t records = 0;
+		size_t end = 0;
+		for( auto && rec : decode( make_source( bytes ), pump_model ) ) {
+			if( rec.offset( ) < end || rec.offset( ) + rec.size( ) > bytes.size( ) ) {
+				fail( "record outside its buffer at " + std::to_string( rec.offset( ) ) );
+			}
+			end = rec.offset( ) + rec.size( );
+			if( !rec.is_error( ) ) {
+				auto const entry = rec.decode( );
+				if( !entry || entry->size( ) != rec.size( ) ) {
+					fail( "framed entry did not decode at " + std::to_string( rec.offset( ) ) );
+				} else {
+					entry->encode( );
+				}
+				++records;
+			}
+		}
+		return records;
+	}
+
+	void write_timestamp( uint8_t * p, int year, int minutes ) {
+		p[0] = 0;
+		p[1] = static_cast<uint8_t>((minutes % 60) | (1 << 6));	// January
+		p[2] = static_cast<uint8_t>((minutes / 60) % 24);
+		p[3] = static_cast<uint8_t>(1 + (minutes / (24*60)) % 28);
+		p[4] = static_cast<uint8_t>(year - 2000);
+	}
+
+	// Entries of op_code with random bytes and, where resyncing would look, a timestamp from
+	// this year, cut at every length
+	void check_truncations( pump_model_t const & pump_model, std::mt19937 & rng ) {
+		auto const decoder = get_history_decoder( pump_model );
+		auto const year = framing_options_t{ }.min_resync_year;
+		std::vector<uint8_t> entry( entry_bytes );
+		for( unsigned op_code = 0; op_code < 256; ++op_code ) {
+			for( size_t trial = 0; trial < trials_per_op_code; ++trial ) {
+				std::generate( entry.begin( ), entry.end( ), [&rng]( ) { return static_cast<uint8_t>(rng( )); } );
+				entry[0] = static_cast<uint8_t>(op_code);
+				if( trial % 2 == 0 ) {
+					write_timestamp( entry.data( ) + 2, year, static_cast<int>(rng( ) % (28*24*60)) );
+				}
+				for( size_t length = 1; length <= entry.size( ); ++length ) {
+					std::vector<uint8_t> truncated( entry.begin( ), entry.begin( ) + static_cast<std::ptrdiff_t>(length) );
+					auto source = make_source( truncated );
+					size_t position = 0;
+					auto const decoded = decoder( source, pump_model, position );
+					if( decoded && decoded->size( ) > length ) {
+						fail( "op_code " + std::to_string( op_code ) + " decoded " + std::to_string( decoded->size( ) ) + " bytes from " + std::to_string( length ) );
+					}
+					decode_all( truncated, pump_model );
+				}
+			}
+		}
+	}
+
+	// Suspend, resume and rewind entries of this year, repeated to size
+	std::vector<uint8_t> clean_dump( size_t size ) {
+		auto const year = framing_options_t{ }.min_resync_year;
+		std::vector<uint8_t> result;
+		uint8_t const op_codes[] = { 0x1E, 0x1F, 0x21 };
+		for( int minutes = 0; result.size( ) + 7 <= size; ++minutes ) {
+			uint8_t entry[7] = { op_codes[minutes % 3], 0, 0, 0, 0, 0, 0 };
+			write_timestamp( entry + 2, year, minutes );
+			result.insert( result.end( ), entry, entry + 7 );
+		}
+		return result;
+	}
+
+	// Entries of the clean dump cut short and run together, so every frame starts on a known
+	// op_code that is missing its end
+	std::vector<uint8_t> truncated_dump( size_t size, std::mt19937 & rng ) {
+		auto const clean = clean_dump( size );
+		std::vector<uint8_t> result;
+		for( size_t offset = 0; offset + 7 <= clean.size( ) && result.size( ) < size; offset += 7 ) {
+			auto const length = std::min<size_t>( 1 + rng( ) % 6, size - result.size( ) );
+			result.insert( result.end( ), clean.begin( ) + static_cast<std::ptrdiff_t>(offset), clean.begin( ) + static_cast<std::ptrdiff_t>(offset + length) );
+		}
+		return result;
+	}
+
+	// Best of three, in nanoseconds per byte
+	double time_decode( std::vector<uint8_t> & bytes, pump_model_t const & pump_model ) {
+		double best = 0.0;
+		for( int run = 0; run < 3; ++run ) {
+			auto const start = std::chrono::steady_clock::now( );
+			decode_all( bytes, pump_model );
+			std::chrono::duration<double, std::nano> const elapsed = std::chrono::steady_clock::now( ) - start;
+			auto const per_byte = elapsed.count( ) / static_cast<double>(bytes.size( ));
+			best = run == 0 ? per_byte : std::min( best, per_byte );
+		}
+		return best;
+	}
+
+	void check_throughput( pump_model_t const & pump_model, std::mt19937 & rng ) {
+		auto clean = clean_dump( buffer_bytes );
+		if( decode_all( clean, pump_model ) != clean.size( )/7 ) {
+			fail( "the clean dump did not decode to its entries" );
+		}
+		std::vector<uint8_t> random_bytes( buffer_bytes );
+		std::generate( random_bytes.begin( ), random_bytes.end( ), [&rng]( ) { return static_cast<uint8_t>(rng( )); } );
+		std::vector<uint8_t> unknown( buffer_bytes, 0xFF );
+		auto truncated = truncated_dump( buffer_bytes, rng );
+
+		auto const clean_cost = time_decode( clean, pump_model );
+		std::cout << "  clean " << clean_cost << " ns/byte\n";
+		auto const compare = [&]( char const * name, std::vector<uint8_t> & bytes ) {
+			auto const cost = time_decode( bytes, pump_model );
+			std::cout << "  " << name << " " << cost << " ns/byte, " << cost/clean_cost << "x clean\n";
+			if( cost > clean_cost*max_slowdown ) {
+				fail( std::string{ name } + " input decoded more than " + std::to_string( max_slowdown ) + "x slower per byte than a clean dump" );
+			}
+		};
+		compare( "random", random_bytes );
+		compare( "unknown op_code", unknown );
+		compare( "truncated", truncated );
+	}
+}	// namespace anonymous
+
+int main( int argc, char ** argv ) {
+	auto const seed = argc > 1 ? static_cast<uint32_t>(std::strtoul( argv[1], nullptr, 10 )) : static_cast<uint32_t>(std::time( nullptr ));
+	std::cout << "seed " << seed << "\n";
+	std::mt19937 rng{ seed };
+	// One model of each pump_family_t
+	for( auto const model : { "522", "523", "551" } ) {
+		pump_model_t const pump_model{ model };
+		std::cout << model << ":\n";
+		check_truncations( pump_model, rng );
+		check_throughput( pump_model, rng );
+	}
+	if( failures > 0 ) {
+		std::cout << failures << " failures\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Merges downloads from one pump that share pages and checks each record comes out once.
+//	- a download is newest page first and is put oldest first
+//	- a page in two downloads is emitted once and counted as duplicates
+// Exits with 0 when every check passed
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "history_decode.h"
+#include "history_merge.h"
+
+namespace {
+	using namespace daw::history;
+
+	size_t const page_body = history_page_size - 2;
+	size_t const entry_size = 7;
+	size_t const entries_per_page = page_body/entry_size;
+	static_assert( page_body % entry_size == 0, "pages are filled with whole entries" );
+
+	int failures = 0;
+
+	void fail( std::string const & what ) {
+		std::cout << "FAILED: " << what << "\n";
+		++failures;
+	}
+
+	// Suspend, resume and rewind entries a minute apart, starting at page's first minute
+	std::vector<uint8_t> make_page( size_t page ) {
+		auto const year = framing_options_t{ }.min_resync_year;
+		uint8_t const op_codes[] = { 0x1E, 0x1F, 0x21 };
+		std::vector<uint8_t> result;
+		for( size_t n = 0; n < entries_per_page; ++n ) {
+			auto const minutes = static_cast<int>(page*entries_per_page + n);
+			uint8_t const entry[entry_size] = {
+				op_codes[minutes % 3], 0, 0,
+				static_cast<uint8_t>((minutes % 60) | (1 << 6)),	// January
+				static_cast<uint8_t>((minutes / 60) % 24),
+				static_cast<uint8_t>(1 + (minutes / (24*60)) % 28),
+				static_cast<uint8_t>(year - 2000) };
+			result.insert( result.end( ), entry, entry + entry_size );
+		}
+		return result;
+	}
+
+	// The pages given, oldest first, as a pump sends them
+	std::vector<uint8_t> make_download( std::vector<size_t> const & pages ) {
+		std::vector<uint8_t> result;
+		for( auto it = pages.rbegin( ); it != pages.rend( ); ++it ) {
+			auto const page = make_page( *it );
+			result.insert( result.end( ), page.begin( ), page.end( ) );
+		}
+		return result;
+	}
+
+	data_source_t make_source( std::vector<uint8_t> & bytes ) {
+		return daw::range::make_range( bytes.data( ), bytes.data( ) + bytes.size( ) );
+	}
+
+	// Drains merge, checking it is in time order and each timestamp is seen once
+	size_t check_ordered( history_merge & merge, char const * name ) {
+		std::set<boost::posix_time::ptime> seen;
+		boost::posix_time::ptime last{ boost::posix_time::neg_infin };
+		size_t records = 0;
+		while( auto entry = merge.next( ) ) {
+			++records;
+			if( !entry->timestamp( ) ) {
+				fail( std::string{ name } + ": record without a timestamp" );
+				continue;
+			}
+			auto const ts = *entry->timestamp( );
+			if( ts < last ) {
+				fail( std::string{ name } + ": " + boost::posix_time::to_simple_string( ts ) + " after " + boost::posix_time::to_simple_string( last ) );
+			}
+			if( !seen.insert( ts ).second ) {
+				fail( std::string{ name } + ": " + boost::posix_time::to_simple_string( ts ) + " emitted twice" );
+			}
+			last = ts;
+		}
+		return records;
+	}
+
+	void check_single_download( pump_model_t const & pump_model ) {
+		auto download = make_download( { 0, 1, 2 } );
+		history_merge merge;
+		merge.add_stream( make_download_stream( make_source( download ), pump_model ) );
+		auto const records = check_ordered( merge, "single download" );
+		if( records != 3*entries_per_page ) {
+			fail( "single download: " + std::to_string( records ) + " records" );
+		}
+	}
+
+	void check_duplicated_page( pump_model_t const & pump_model ) {
+		auto older = make_download( { 0, 1, 2 } );
+		auto newer = make_download( { 2, 3 } );
+		history_merge merge;
+		merge.add_stream( make_download_stream( make_source( newer ), pump_model ) );
+		merge.add_stream( make_download_stream( make_source( older ), pump_model ) );
+		auto const records = check_ordered( merge, "duplicated page" );
+		if( records != 4*entries_per_page ) {
+			fail( "duplicated page: " + std::to_string( records ) + " records" );
+		}
+		if( merge.duplicates( ) != entries_per_page ) {
+			fail( "duplicated page: " + std::to_string( merge.duplicates( ) ) + " duplicates" );
+		}
+	}
+}	// namespace anonymous
+
+int main( ) {
+	for( auto const model : { "522", "523", "551" } ) {
+		pump_model_t const pump_model{ model };
+		check_single_download( pump_model );
+		check_duplicated_page( pump_model );
+	}
+	if( failures > 0 ) {
+		std::cout << failures << " failures\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Drives the C interface the way an embedding program would.  Two copies of a page, the
+// second with a bad CRC, are fed in odd sized chunks and every record and error span read
+// back is checked against what was written.  Exits with 0 when all checks pass
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "minimed_history.h"
+
+enum {
+	page_size = 1024,
+	page_count = 2,
+	max_records = 32
+};
+
+typedef struct expected_record {
+	uint32_t offset;
+	uint32_t size;
+	uint8_t op_code;
+	uint8_t flags;	// of the good page, the bad one adds MINIMED_HISTORY_RECORD_BAD_CRC
+	int minute_of_day;	// -1 for error spans
+} expected_record;
+
+// Suspend, resume, five bytes no entry starts with and then a rewind found by resyncing on
+// its timestamp.  The zeros padding the rest of the page are not records
+static expected_record const expected[] = {
+	{ 0, 7, 0x1E, 0, 9*60 },
+	{ 7, 7, 0x1F, 0, 9*60 + 30 },
+	{ 14, 5, 0x00, MINIMED_HISTORY_RECORD_ERROR, -1 },
+	{ 19, 7, 0x21, 0, 12*60 }
+};
+enum { expected_per_page = sizeof( expected )/sizeof( expected[0] ) };
+
+static int failures = 0;
+
+#define CHECK( condition ) check( (condition), #condition, __LINE__ )
+
+static void check( int condition, char const * what, int line ) {
+	if( !condition ) {
+		fprintf( stderr, "minimed_history_test.c:%d: check failed: %s\n", line, what );
+		++failures;
+	}
+}
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+static int64_t days_from_civil( int64_t year, int month, int day ) {
+	year -= month <= 2;
+	int64_t const era = (year >= 0 ? year : year - 399)/400;
+	int64_t const year_of_era = year - era*400;
+	int64_t const day_of_year = (153*(month + (month > 2 ? -3 : 9)) + 2)/5 + day - 1;
+	int64_t const day_of_era = year_of_era*365 + year_of_era/4 - year_of_era/100 + day_of_year;
+	return era*146097 + day_of_era - 719468;
+}
+
+// Resyncing only trusts timestamps from this year, so the records are written in it
+static int current_year( void ) {
+	int64_t const today = (int64_t)time( NULL )/(24*60*60);
+	int year = 1970;
+	while( days_from_civil( year + 1, 1, 1 ) <= today ) {
+		++year;
+	}
+	return year;
+}
+
+static void write_timestamp( uint8_t * p, int year, int month, int day, int minute_of_day ) {
+	p[0] = (uint8_t)((month >> 2) << 6);
+	p[1] = (uint8_t)((minute_of_day % 60) | ((month & 3) << 6));
+	p[2] = (uint8_t)(minute_of_day/60);
+	p[3] = (uint8_t)day;
+	p[4] = (uint8_t)(year - 2000);
+}
+
+static uint16_t crc16( uint8_t const * data, size_t size ) {
+	uint16_t crc = 0xFFFF;
+	for( size_t n = 0; n < size; ++n ) {
+		crc ^= (uint16_t)(data[n] << 8);
+		for( int bit = 0; bit < 8; ++bit ) {
+			crc = (uint16_t)((crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1);
+		}
+	}
+	return crc;
+}
+
+static void build_page( uint8_t * page, int year, int good_crc ) {
+	memset( page, 0, page_size );
+	for( size_t n = 0; n < expected_per_page; ++n ) {
+		uint8_t * record = page + expected[n].offset;
+		if( expected[n].flags & MINIMED_HISTORY_RECORD_ERROR ) {
+			memset( record, 0xEE, expected[n].size );
+		} else {
+			record[0] = expected[n].op_code;
+			write_timestamp( record + 2, year, 3, 1, expected[n].minute_of_day );
+		}
+	}
+	uint16_t crc = crc16( page, page_size - 2 );
+	if( !good_crc ) {
+		crc ^= 1;
+	}
+	page[page_size - 2] = (uint8_t)(crc >> 8);
+	page[page_size - 1] = (uint8_t)crc;
+}
+
+static void check_record( minimed_history_session * session, minimed_history_record const * record, size_t index, int64_t first_day ) {
+	uint32_t const page = (uint32_t)(index/expected_per_page);
+	expected_record const * want = &expected[index % expected_per_page];
+	uint8_t const flags = (uint8_t)(want->flags | (page == 1 ? MINIMED_HISTORY_RECORD_BAD_CRC : 0));
+	CHECK( record->page == page );
+	CHECK( record->offset == want->offset );
+	CHECK( record->size == want->size );
+	CHECK( record->flags == flags );
+	char const * json = NULL;
+	if( want->flags & MINIMED_HISTORY_RECORD_ERROR ) {
+		CHECK( record->data == NULL );
+		CHECK( record->timestamp == INT64_MIN );
+		CHECK( minimed_history_record_json( session, record, &json ) == MINIMED_HISTORY_INVALID_ARGUMENT );
+		return;
+	}
+	CHECK( record->op_code == want->op_code );
+	CHECK( record->data != NULL && record->data[0] == want->op_code );
+	CHECK( record->timestamp == first_day*24*60*60 + want->minute_of_day*60 );
+	CHECK( minimed_history_record_json( session, record, &json ) == MINIMED_HISTORY_OK );
+	CHECK( json != NULL );
+}
+
+// Feeds bytes in chunks of the given sizes, repeating them until all is fed, and reads the
+// records back after every chunk
+static void run( uint8_t const * bytes, size_t size, size_t const * chunks, size_t chunk_count, int64_t first_day ) {
+	minimed_history_session * session = NULL;
+	CHECK( minimed_history_create( "523", "UTC", &session ) == MINIMED_HISTORY_OK );
+	if( !session ) {
+		return;
+	}
+	size_t fed = 0;
+	size_t records = 0;
+	for( size_t chunk = 0; fed < size; ++chunk ) {
+		size_t length = chunks[chunk % chunk_count];
+		if( length > size - fed ) {
+			length = size - fed;
+		}
+		CHECK( minimed_history_feed( session, bytes + fed, length ) == MINIMED_HISTORY_OK );
+		fed += length;
+
+		minimed_history_record record;
+		minimed_history_status status;
+		while( (status = minimed_history_next( session, &record )) == MINIMED_HISTORY_OK ) {
+			// Nothing is returned before its whole page has been fed
+			CHECK( (record.page + 1)*(size_t)page_size <= fed );
+			if( records < page_count*expected_per_page ) {
+				check_record( session, &record, records, first_day );
+			}
+			++records;
+		}
+		CHECK( status == MINIMED_HISTORY_END );
+	}
+	CHECK( records == page_count*expected_per_page );
+	minimed_history_destroy( session );
+}
+
+int main( void ) {
+	int const year = current_year( );
+	int64_t const first_day = days_from_civil( year, 3, 1 );
+	static uint8_t bytes[page_count*page_size];
+	build_page( bytes, year, 1 );
+	build_page( bytes + page_size, year, 0 );
+
+	static size_t const whole[] = { page_count*page_size };
+	static size_t const single_bytes[] = { 1 };
+	static size_t const odd[] = { 7, 333, 1023, 5 };
+	static size_t const straddling[] = { 1025, 3 };
+	run( bytes, sizeof( bytes ), whole, 1, first_day );
+	run( bytes, sizeof( bytes ), single_bytes, 1, first_day );
+	run( bytes, sizeof( bytes ), odd, sizeof( odd )/sizeof( odd[0] ), first_day );
+	run( bytes, sizeof( bytes ), straddling, sizeof( straddling )/sizeof( straddling[0] ), first_day );
+
+	minimed_history_session * session = NULL;
+	CHECK( minimed_history_create( "52x", NULL, &session ) == MINIMED_HISTORY_INVALID_MODEL );
+	CHECK( minimed_history_create( "523", "Not/A_Zone", &session ) == MINIMED_HISTORY_INVALID_ZONE );
+	CHECK( session == NULL );
+	CHECK( minimed_history_feed( NULL, bytes, 1 ) == MINIMED_HISTORY_INVALID_ARGUMENT );
+
+	if( failures > 0 ) {
+		fprintf( stderr, "%d checks failed\n", failures );
+		return 1;
+	}
+	printf( "minimed_history_test: all checks passed\n" );
+	return 0;
+}
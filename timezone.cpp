@@ -0,0 +1,478 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include "history_pages_base.h"
+#include "timezone.h"
+
+namespace daw {
+	namespace history {
+		namespace {
+			constexpr int64_t const seconds_per_day = 86400;
+
+			int64_t days_from_civil( int64_t year, unsigned month, unsigned day ) {
+				year -= month <= 2 ? 1 : 0;
+				auto const era = (year >= 0 ? year : year - 399)/400;
+				auto const year_of_era = static_cast<unsigned>(year - era*400);
+				auto const day_of_year = (153*(month > 2 ? month - 3 : month + 9) + 2)/5 + day - 1;
+				auto const day_of_era = year_of_era*365 + year_of_era/4 - year_of_era/100 + day_of_year;
+				return era*146097 + static_cast<int64_t>(day_of_era) - 719468;
+			}
+
+			bool is_leap_year( int64_t year ) {
+				return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+			}
+
+			unsigned days_in_month( int64_t year, unsigned month ) {
+				static unsigned const days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+				return month == 2 && is_leap_year( year ) ? 29 : days[month - 1];
+			}
+
+			// 0 is Sunday, 1970-01-01 was a Thursday
+			unsigned weekday( int64_t days ) {
+				return static_cast<unsigned>(((days + 4) % 7 + 7) % 7);
+			}
+
+			// Jn, n or Mm.w.d from a POSIX TZ string, with the local time of day it changes at
+			struct rule_date_t {
+				char kind;	// 'J', 'N' or 'M'
+				unsigned month;
+				unsigned week;
+				unsigned day;
+				int32_t time;
+			};	// rule_date_t
+
+			int64_t rule_day( rule_date_t const & rule, int64_t year ) {
+				auto const jan_1 = days_from_civil( year, 1, 1 );
+				switch( rule.kind ) {
+				case 'J':
+					// 1 - 365, February 29th is never counted
+					return jan_1 + rule.day - 1 + (is_leap_year( year ) && rule.day >= 60 ? 1 : 0);
+				case 'N':
+					return jan_1 + rule.day;
+				default: {
+						auto const first = days_from_civil( year, rule.month, 1 );
+						auto day = 1 + (rule.day + 7 - weekday( first )) % 7 + (rule.week - 1)*7;
+						while( day > days_in_month( year, rule.month ) ) {
+							day -= 7;
+						}
+						return first + day - 1;
+					}
+				}
+			}
+
+			struct posix_tz_t {
+				int32_t std_offset;	// seconds east of UTC
+				bool has_dst;
+				int32_t dst_offset;
+				rule_date_t start;	// in standard time
+				rule_date_t end;	// in daylight time
+			};	// posix_tz_t
+
+			class posix_tz_parser {
+				std::string const & m_str;
+				size_t m_pos;
+
+				bool at_end( ) const {
+					return m_pos >= m_str.size( );
+				}
+
+				char peek( ) const {
+					return at_end( ) ? '\0' : m_str[m_pos];
+				}
+
+				bool is_digit( ) const {
+					return peek( ) >= '0' && peek( ) <= '9';
+				}
+
+				bool number( unsigned & result ) {
+					if( !is_digit( ) ) {
+						return false;
+					}
+					result = 0;
+					while( is_digit( ) && result < 10000 ) {
+						result = result*10 + static_cast<unsigned>(m_str[m_pos++] - '0');
+					}
+					return true;
+				}
+
+				bool name( ) {
+					if( peek( ) == '<' ) {
+						auto const last = m_str.find( '>', m_pos );
+						if( last == std::string::npos ) {
+							return false;
+						}
+						m_pos = last + 1;
+						return true;
+					}
+					auto const first = m_pos;
+					while( (peek( ) >= 'A' && peek( ) <= 'Z') || (peek( ) >= 'a' && peek( ) <= 'z') ) {
+						++m_pos;
+					}
+					return m_pos - first >= 3;
+				}
+
+				// [+|-]hh[:mm[:ss]]
+				bool duration( int32_t & result ) {
+					int32_t sign = 1;
+					if( peek( ) == '+' || peek( ) == '-' ) {
+						sign = m_str[m_pos++] == '-' ? -1 : 1;
+					}
+					unsigned hours = 0;
+					unsigned minutes = 0;
+					unsigned seconds = 0;
+					if( !number( hours ) || hours > 167 ) {
+						return false;
+					}
+					if( peek( ) == ':' ) {
+						++m_pos;
+						if( !number( minutes ) || minutes > 59 ) {
+							return false;
+						}
+						if( peek( ) == ':' ) {
+							++m_pos;
+							if( !number( seconds ) || seconds > 59 ) {
+								return false;
+							}
+						}
+					}
+					result = sign*static_cast<int32_t>(hours*3600 + minutes*60 + seconds);
+					return true;
+				}
+
+				bool date( rule_date_t & result ) {
+					result = rule_date_t{ 'N', 0, 0, 0, 7200 };
+					if( peek( ) == 'M' ) {
+						++m_pos;
+						result.kind = 'M';
+						if( !number( result.month ) || result.month < 1 || result.month > 12 || peek( ) != '.' ) {
+							return false;
+						}
+						++m_pos;
+						if( !number( result.week ) || result.week < 1 || result.week > 5 || peek( ) != '.' ) {
+							return false;
+						}
+						++m_pos;
+						if( !number( result.day ) || result.day > 6 ) {
+							return false;
+						}
+					} else if( peek( ) == 'J' ) {
+						++m_pos;
+						result.kind = 'J';
+						if( !number( result.day ) || result.day < 1 || result.day > 365 ) {
+							return false;
+						}
+					} else if( !number( result.day ) || result.day > 365 ) {
+						return false;
+					}
+					if( peek( ) == '/' ) {
+						++m_pos;
+						return duration( result.time );
+					}
+					return true;
+				}
+			public:
+				explicit posix_tz_parser( std::string const & str ):
+					m_str{ str },
+					m_pos{ 0 } { }
+
+				// POSIX offsets are west of UTC
+				boost::optional<posix_tz_t> parse( ) {
+					posix_tz_t result{ 0, false, 0, rule_date_t{ }, rule_date_t{ } };
+					int32_t offset = 0;
+					if( !name( ) || !duration( offset ) ) {
+						return boost::optional<posix_tz_t>{ };
+					}
+					result.std_offset = -offset;
+					if( at_end( ) ) {
+						return result;
+					}
+					if( !name( ) ) {
+						return boost::optional<posix_tz_t>{ };
+					}
+					result.has_dst = true;
+					result.dst_offset = result.std_offset + 3600;
+					if( !at_end( ) && peek( ) != ',' ) {
+						if( !duration( offset ) ) {
+							return boost::optional<posix_tz_t>{ };
+						}
+						result.dst_offset = -offset;
+					}
+					if( at_end( ) ) {
+						// The US rules are the POSIX default
+						result.start = rule_date_t{ 'M', 3, 2, 0, 7200 };
+						result.end = rule_date_t{ 'M', 11, 1, 0, 7200 };
+						return result;
+					}
+					++m_pos;
+					if( !date( result.start ) || peek( ) != ',' ) {
+						return boost::optional<posix_tz_t>{ };
+					}
+					++m_pos;
+					if( !date( result.end ) || !at_end( ) ) {
+						return boost::optional<posix_tz_t>{ };
+					}
+					return result;
+				}
+			};	// posix_tz_parser
+
+			void add_rule_transitions( posix_tz_t const & rule, int64_t year, std::vector<zone_transition_t> & transitions ) {
+				auto const start = rule_day( rule.start, year )*seconds_per_day + rule.start.time - rule.std_offset;
+				auto const end = rule_day( rule.end, year )*seconds_per_day + rule.end.time - rule.dst_offset;
+				if( start < end ) {
+					transitions.push_back( zone_transition_t{ start, rule.dst_offset } );
+					transitions.push_back( zone_transition_t{ end, rule.std_offset } );
+				} else {
+					// Southern hemisphere, the year starts in daylight time
+					transitions.push_back( zone_transition_t{ end, rule.std_offset } );
+					transitions.push_back( zone_transition_t{ start, rule.dst_offset } );
+				}
+			}
+
+			struct tzif_t {
+				int32_t initial_offset;
+				std::vector<zone_transition_t> transitions;
+				std::string footer;
+			};	// tzif_t
+
+			uint32_t read_be32( std::vector<uint8_t> const & data, size_t pos ) {
+				return static_cast<uint32_t>(data[pos]) << 24 | static_cast<uint32_t>(data[pos + 1]) << 16 | static_cast<uint32_t>(data[pos + 2]) << 8 | data[pos + 3];
+			}
+
+			int64_t read_be64( std::vector<uint8_t> const & data, size_t pos ) {
+				return static_cast<int64_t>(static_cast<uint64_t>(read_be32( data, pos )) << 32 | read_be32( data, pos + 4 ));
+			}
+
+			// RFC 8536.  Version 2 and later files repeat the data with 64 bit times and end in
+			// a TZ string for the times after the last transition
+			boost::optional<tzif_t> parse_tzif( std::vector<uint8_t> const & data ) {
+				constexpr size_t const header_size = 44;
+				size_t pos = 0;
+				size_t time_size = 4;
+				for( ;; ) {
+					if( data.size( ) < pos + header_size || data[pos] != 'T' || data[pos + 1] != 'Z' || data[pos + 2] != 'i' || data[pos + 3] != 'f' ) {
+						return boost::optional<tzif_t>{ };
+					}
+					auto const version = data[pos + 4];
+					size_t const isut_count = read_be32( data, pos + 20 );
+					size_t const isstd_count = read_be32( data, pos + 24 );
+					size_t const leap_count = read_be32( data, pos + 28 );
+					size_t const time_count = read_be32( data, pos + 32 );
+					size_t const type_count = read_be32( data, pos + 36 );
+					size_t const char_count = read_be32( data, pos + 40 );
+					auto const block_size = time_count*time_size + time_count + type_count*6 + char_count + leap_count*(time_size + 4) + isstd_count + isut_count;
+					if( type_count == 0 || data.size( ) - pos - header_size < block_size ) {
+						return boost::optional<tzif_t>{ };
+					}
+					if( time_size == 4 && version >= '2' ) {
+						pos += header_size + block_size;
+						time_size = 8;
+						continue;
+					}
+					auto const times = pos + header_size;
+					auto const indices = times + time_count*time_size;
+					auto const types = indices + time_count;
+					auto const type_offset = [&]( size_t type ) {
+						return static_cast<int32_t>(read_be32( data, types + type*6 ));
+					};
+					tzif_t result{ type_offset( 0 ), { }, { } };
+					result.transitions.reserve( time_count );
+					for( size_t n = 0; n < time_count; ++n ) {
+						auto const type = data[indices + n];
+						if( type >= type_count ) {
+							return boost::optional<tzif_t>{ };
+						}
+						auto const utc = time_size == 8 ? read_be64( data, times + n*8 ) : static_cast<int64_t>(static_cast<int32_t>(read_be32( data, times + n*4 )));
+						result.transitions.push_back( zone_transition_t{ utc, type_offset( type ) } );
+					}
+					auto const footer = pos + header_size + block_size;
+					if( time_size == 8 && footer < data.size( ) && data[footer] == '\n' ) {
+						auto const last = std::find( data.begin( ) + static_cast<ptrdiff_t>(footer) + 1, data.end( ), '\n' );
+						if( last != data.end( ) ) {
+							result.footer.assign( data.begin( ) + static_cast<ptrdiff_t>(footer) + 1, last );
+						}
+					}
+					return result;
+				}
+			}
+
+			boost::optional<std::vector<uint8_t>> read_zone_file( std::string const & name ) {
+				if( name.empty( ) || name.find( ".." ) != std::string::npos ) {
+					return boost::optional<std::vector<uint8_t>>{ };
+				}
+				std::string path = name;
+				if( name[0] != '/' ) {
+					auto const tzdir = std::getenv( "TZDIR" );
+					path = std::string{ tzdir && *tzdir ? tzdir : "/usr/share/zoneinfo" } + "/" + name;
+				}
+				std::ifstream in{ path, std::ios::binary };
+				if( !in ) {
+					return boost::optional<std::vector<uint8_t>>{ };
+				}
+				return std::vector<uint8_t>{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{ } };
+			}
+		}	// namespace anonymous
+
+		timezone_table::timezone_table( std::string name, int32_t initial_offset, std::vector<zone_transition_t> const & transitions ):
+				m_name{ std::move( name ) },
+				m_local_starts{ std::numeric_limits<int64_t>::min( ) },
+				m_offsets{ initial_offset },
+				m_last{ 0 } {
+
+			m_local_starts.reserve( transitions.size( ) + 1 );
+			m_offsets.reserve( transitions.size( ) + 1 );
+			for( auto const & transition : transitions ) {
+				if( transition.offset == m_offsets.back( ) ) {
+					continue;
+				}
+				auto const local_start = transition.utc + m_offsets.back( );
+				if( local_start <= m_local_starts.back( ) ) {
+					m_offsets.back( ) = transition.offset;
+					continue;
+				}
+				m_local_starts.push_back( local_start );
+				m_offsets.push_back( transition.offset );
+			}
+		}
+
+		std::string const & timezone_table::name( ) const {
+			return m_name;
+		}
+
+		size_t timezone_table::transitions( ) const {
+			return m_offsets.size( ) - 1;
+		}
+
+		bool timezone_table::covers( size_t period, int64_t local_seconds ) const {
+			return period < m_local_starts.size( ) && m_local_starts[period] <= local_seconds && (period + 1 == m_local_starts.size( ) || local_seconds < m_local_starts[period + 1]);
+		}
+
+		size_t timezone_table::find( int64_t local_seconds ) const {
+			auto const last = m_last.load( std::memory_order_relaxed );
+			if( covers( last, local_seconds ) ) {
+				return last;
+			}
+			if( covers( last + 1, local_seconds ) ) {
+				m_last.store( last + 1, std::memory_order_relaxed );
+				return last + 1;
+			}
+			auto const pos = std::upper_bound( m_local_starts.begin( ), m_local_starts.end( ), local_seconds );
+			auto const result = static_cast<size_t>(std::distance( m_local_starts.begin( ), pos )) - 1;
+			m_last.store( result, std::memory_order_relaxed );
+			return result;
+		}
+
+		int32_t timezone_table::offset_at_local( int64_t local_seconds ) const {
+			return m_offsets[find( local_seconds )];
+		}
+
+		int64_t timezone_table::to_utc( int64_t local_seconds ) const {
+			return local_seconds - offset_at_local( local_seconds );
+		}
+
+		std::shared_ptr<timezone_table const> load_timezone( std::string const & name, uint16_t first_year, uint16_t last_year ) {
+			auto const range_first = days_from_civil( first_year, 1, 1 )*seconds_per_day - seconds_per_day;
+			auto const range_last = days_from_civil( static_cast<int64_t>(last_year) + 1, 1, 1 )*seconds_per_day + seconds_per_day;
+
+			tzif_t zone{ 0, { }, { } };
+			auto const file = read_zone_file( name );
+			if( file ) {
+				auto tzif = parse_tzif( *file );
+				if( !tzif ) {
+					throw std::runtime_error( "Invalid tzdata file for timezone " + name );
+				}
+				zone = std::move( *tzif );
+			} else {
+				zone.footer = name;
+			}
+			boost::optional<posix_tz_t> rule;
+			if( !zone.footer.empty( ) ) {
+				rule = posix_tz_parser{ zone.footer }.parse( );
+				if( !rule && !file ) {
+					throw std::runtime_error( "Unknown timezone " + name );
+				}
+				if( rule && !file ) {
+					zone.initial_offset = rule->std_offset;
+				}
+			}
+
+			int32_t initial_offset = zone.initial_offset;
+			std::vector<zone_transition_t> transitions;
+			for( auto const & transition : zone.transitions ) {
+				if( transition.utc <= range_first ) {
+					initial_offset = transition.offset;
+				} else if( transition.utc < range_last ) {
+					transitions.push_back( transition );
+				}
+			}
+			if( rule ) {
+				auto const table_end = zone.transitions.empty( ) ? std::numeric_limits<int64_t>::min( ) : zone.transitions.back( ).utc;
+				if( !rule->has_dst ) {
+					if( table_end <= range_first ) {
+						initial_offset = rule->std_offset;
+					} else if( table_end < range_last ) {
+						transitions.push_back( zone_transition_t{ table_end, rule->std_offset } );
+					}
+				} else {
+					std::vector<zone_transition_t> rule_transitions;
+					for( int64_t year = static_cast<int64_t>(first_year) - 1; year <= last_year; ++year ) {
+						add_rule_transitions( *rule, year, rule_transitions );
+					}
+					for( auto const & transition : rule_transitions ) {
+						if( transition.utc <= table_end ) {
+							continue;
+						}
+						if( transition.utc <= range_first ) {
+							initial_offset = transition.offset;
+						} else if( transition.utc < range_last ) {
+							transitions.push_back( transition );
+						}
+					}
+				}
+			}
+			return std::make_shared<timezone_table const>( name, initial_offset, transitions );
+		}
+
+		std::shared_ptr<timezone_table const> load_pump_timezone( std::string const & name ) {
+			auto const today = static_cast<int64_t>(std::time( nullptr ))/seconds_per_day;
+			int64_t year = 1970;
+			while( days_from_civil( year + 1, 1, 1 ) <= today ) {
+				++year;
+			}
+			return load_timezone( name, 2000, static_cast<uint16_t>(year + 1) );
+		}
+
+		int32_t utc_offset_at_local( timezone_table const * zone, int64_t local_seconds ) {
+			if( !zone ) {
+				return seconds_from_gmt( );
+			}
+			return zone->offset_at_local( local_seconds );
+		}
+	}	// namespace history
+}	// namespace daw
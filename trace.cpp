@@ -0,0 +1,196 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2015 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "trace.h"
+
+namespace daw {
+	namespace trace {
+		namespace {
+			using clock_t = std::chrono::steady_clock;
+
+			struct trace_event_t {
+				char const * name;
+				char const * category;
+				char const * arg_name;
+				int64_t arg_value;
+				int64_t start;		// nanoseconds since the trace was enabled
+				int64_t duration;
+				char phase;			// X for a span, C for a counter
+			};	// trace_event_t
+
+			struct thread_buffer_t {
+				uint32_t tid;
+				char const * name;
+				std::vector<trace_event_t> events;
+			};	// thread_buffer_t
+
+			struct registry_t {
+				std::atomic<bool> is_enabled;
+				clock_t::time_point origin;
+				std::mutex mutex;	// only taken the first time a thread records
+				std::vector<std::unique_ptr<thread_buffer_t>> buffers;
+
+				registry_t( ):
+					is_enabled{ false },
+					origin{ clock_t::now( ) },
+					mutex{ },
+					buffers{ } { }
+			};	// registry_t
+
+			registry_t & registry( ) {
+				static registry_t result;
+				return result;
+			}
+
+			// Buffers belong to the registry so they outlive their threads
+			thread_buffer_t & local_buffer( ) {
+				thread_local thread_buffer_t * buffer = nullptr;
+				if( !buffer ) {
+					auto & reg = registry( );
+					std::lock_guard<std::mutex> lock( reg.mutex );
+					reg.buffers.push_back( std::make_unique<thread_buffer_t>( ) );
+					buffer = reg.buffers.back( ).get( );
+					buffer->tid = static_cast<uint32_t>(reg.buffers.size( ));
+					buffer->name = nullptr;
+					buffer->events.reserve( 4096 );
+				}
+				return *buffer;
+			}
+
+			int64_t now( ) {
+				return std::chrono::duration_cast<std::chrono::nanoseconds>( clock_t::now( ) - registry( ).origin ).count( );
+			}
+
+			void write_string( std::ostream & os, char const * str ) {
+				os << '"';
+				for( ; str && *str; ++str ) {
+					if( *str == '"' || *str == '\\' ) {
+						os << '\\';
+					}
+					os << *str;
+				}
+				os << '"';
+			}
+
+			void write_microseconds( std::ostream & os, int64_t nanoseconds ) {
+				os << nanoseconds/1000 << '.' << std::setw( 3 ) << std::setfill( '0' ) << nanoseconds%1000;
+			}
+		}	// namespace anonymous
+
+		bool enabled( ) noexcept {
+			return registry( ).is_enabled.load( std::memory_order_relaxed );
+		}
+
+		void enable( ) {
+			auto & reg = registry( );
+			reg.origin = clock_t::now( );
+			reg.is_enabled.store( true );
+		}
+
+		void set_thread_name( char const * name ) {
+			if( enabled( ) ) {
+				local_buffer( ).name = name;
+			}
+		}
+
+		scoped_span::scoped_span( char const * name, char const * category ):
+			scoped_span{ name, category, nullptr, 0 } { }
+
+		scoped_span::scoped_span( char const * name, char const * category, char const * arg_name, int64_t arg_value ):
+			m_name{ name },
+			m_category{ category },
+			m_arg_name{ arg_name },
+			m_arg_value{ arg_value },
+			m_start{ 0 },
+			m_active{ enabled( ) } {
+
+			if( m_active ) {
+				m_start = now( );
+			}
+		}
+
+		scoped_span::~scoped_span( ) {
+			if( m_active ) {
+				local_buffer( ).events.push_back( trace_event_t{ m_name, m_category, m_arg_name, m_arg_value, m_start, now( ) - m_start, 'X' } );
+			}
+		}
+
+		void counter( char const * name, int64_t value ) {
+			if( enabled( ) ) {
+				local_buffer( ).events.push_back( trace_event_t{ name, "counter", name, value, now( ), 0, 'C' } );
+			}
+		}
+
+		bool write_chrome_trace( std::string const & file_name ) {
+			std::ofstream out( file_name.c_str( ) );
+			if( !out ) {
+				return false;
+			}
+			auto & reg = registry( );
+			std::lock_guard<std::mutex> lock( reg.mutex );
+			out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+			bool first = true;
+			auto const separator = [&]( ) {
+				if( !first ) {
+					out << ",\n";
+				}
+				first = false;
+			};
+			for( auto const & buffer : reg.buffers ) {
+				if( buffer->name ) {
+					separator( );
+					out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+					write_string( out, buffer->name );
+					out << "}}";
+				}
+				for( auto const & event : buffer->events ) {
+					separator( );
+					out << "{\"ph\":\"" << event.phase << "\",\"name\":";
+					write_string( out, event.name );
+					out << ",\"cat\":";
+					write_string( out, event.category );
+					out << ",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":";
+					write_microseconds( out, event.start );
+					if( event.phase == 'X' ) {
+						out << ",\"dur\":";
+						write_microseconds( out, event.duration );
+					}
+					if( event.arg_name ) {
+						out << ",\"args\":{";
+						write_string( out, event.arg_name );
+						out << ":" << event.arg_value << "}";
+					}
+					out << "}";
+				}
+			}
+			out << "]}\n";
+			return static_cast<bool>(out);
+		}
+	}	// namespace trace
+}	// namespace daw